@@ -115,6 +115,7 @@ struct tlbshootdown {
 	 */
 	struct addrspace *ts_addrspace;
 	vaddr_t ts_vaddr;
+	unsigned ts_npages;		/* pages starting at ts_vaddr */
 };
 
 #define TLBSHOOTDOWN_MAX 16
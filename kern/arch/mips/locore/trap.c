@@ -124,10 +124,10 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 		pid_t pid_process=curthread->t_pid;
 
 		//Store the exit code passed in the argument
-		process_array[pid_process]->exit_code= 0;
+		proc_get(pid_process)->exit_code= 0;
 
 		//Indicate Exit by calling changing the exit status in the process array
-		process_array[pid_process]->exit_status=true;
+		proc_get(pid_process)->exit_status=true;
 
 		thread_exit();
 */
@@ -173,6 +173,7 @@ mips_trap(struct trapframe *tf)
 
 		old_in = curthread->t_in_interrupt;
 		curthread->t_in_interrupt = 1;
+		curthread->t_intr_from_user = !iskern;
 
 		/*
 		 * The processor has turned interrupts off; if the
@@ -36,6 +36,10 @@
 #include <current.h>
 #include <syscall.h>
 #include <file_syscall.h>
+#include <futex.h>
+#include <sysbatch.h>
+#include <syscallstat.h>
+#include <copyinout.h>
 
 
 /*
@@ -83,6 +87,9 @@ syscall(struct trapframe *tf)
 	int32_t retval;
 	int32_t ret_value;
 	int err;
+#if OPT_SYSCALLSTAT
+	uint64_t starttime;
+#endif
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -90,6 +97,10 @@ syscall(struct trapframe *tf)
 
 	callno = tf->tf_v0;
 
+#if OPT_SYSCALLSTAT
+	starttime = syscallstat_now();
+#endif
+
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
 	 * really return a value, just 0 for success and -1 on
@@ -102,6 +113,8 @@ syscall(struct trapframe *tf)
 	retval = 0;
 	ret_value=0;
 	int64_t lseek_variable=0;
+	off_t pos;
+	uint32_t stackargs[2];
 	switch (callno) {
 	    case SYS_reboot:
 		err = sys_reboot(tf->tf_a0);
@@ -112,6 +125,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 	    case SYS_open:
 	    	err= sys_open((userptr_t)tf->tf_a0,
 	    			tf->tf_a1, &retval);
@@ -121,6 +139,10 @@ syscall(struct trapframe *tf)
 	    	err= sys_close(tf->tf_a0);
 	    break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
 	    case SYS_read:
 	    	err= sys_read(tf->tf_a0, (userptr_t)tf->tf_a1,
 	    			tf->tf_a2, &retval);
@@ -130,6 +152,55 @@ syscall(struct trapframe *tf)
 	    		tf->tf_a2, &retval);
 	    break;
 
+	    /* len and flags are on the stack after the four registers */
+	    case SYS_copy_file_range:
+		err = copyin((const_userptr_t)(tf->tf_sp+16), stackargs,
+			     sizeof(stackargs));
+		if (err == 0) {
+			err = sys_copy_file_range(tf->tf_a0,
+						  (userptr_t)tf->tf_a1,
+						  tf->tf_a2,
+						  (userptr_t)tf->tf_a3,
+						  stackargs[0], stackargs[1],
+						  &retval);
+		}
+		break;
+
+	    case SYS_getdirentries:
+		err = sys_getdirentries(tf->tf_a0, (userptr_t)tf->tf_a1,
+					tf->tf_a2, (userptr_t)tf->tf_a3,
+					&retval);
+		break;
+
+	    case SYS_readv:
+		err = sys_readv(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				tf->tf_a2, &retval);
+		break;
+
+	    case SYS_writev:
+		err = sys_writev(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				 tf->tf_a2, &retval);
+		break;
+
+	    /* The 64-bit offset is aligned, so it's on the stack */
+	    case SYS_pread:
+		err = copyin((const_userptr_t)(tf->tf_sp+16), &pos,
+			     sizeof(pos));
+		if (err == 0) {
+			err = sys_pread(tf->tf_a0, (userptr_t)tf->tf_a1,
+					tf->tf_a2, pos, &retval);
+		}
+		break;
+
+	    case SYS_pwrite:
+		err = copyin((const_userptr_t)(tf->tf_sp+16), &pos,
+			     sizeof(pos));
+		if (err == 0) {
+			err = sys_pwrite(tf->tf_a0, (userptr_t)tf->tf_a1,
+					 tf->tf_a2, pos, &retval);
+		}
+		break;
+
 	    case SYS_dup2:
 	    err= dup2(tf->tf_a0,tf->tf_a1, &retval);
 	    break;
@@ -180,12 +251,83 @@ syscall(struct trapframe *tf)
 	    err= sys___sbrk(tf->tf_a0, &retval);
 	    break;
 
+	    case SYS_mmap:
+		/* fd is the fifth argument; the 64-bit offset is aligned */
+		err = copyin((const_userptr_t)(tf->tf_sp+16), &stackargs[0],
+			     sizeof(stackargs[0]));
+		if (err == 0) {
+			err = copyin((const_userptr_t)(tf->tf_sp+24), &pos,
+				     sizeof(pos));
+		}
+		if (err == 0) {
+			err = sys_mmap((userptr_t)tf->tf_a0, tf->tf_a1,
+				       tf->tf_a2, tf->tf_a3,
+				       (int)stackargs[0], pos, &retval);
+		}
+		break;
+
+	    case SYS_munmap:
+		err = sys_munmap((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_getrusage:
+	    err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+	    break;
+
+	    case SYS___threadcreate:
+	    err = sys___threadcreate(tf, (userptr_t)tf->tf_a0,
+				     (userptr_t)tf->tf_a1, &retval);
+	    break;
+
+	    case SYS_threadexit:
+	    err = sys_threadexit(tf->tf_a0);
+	    break;
+
+	    case SYS___threadjoin:
+	    err = sys___threadjoin(tf->tf_a0, (userptr_t)tf->tf_a1);
+	    break;
+
+	    case SYS_futex_wait:
+	    err = sys_futex_wait((userptr_t)tf->tf_a0, tf->tf_a1);
+	    break;
+
+	    case SYS_futex_wake:
+	    err = sys_futex_wake((userptr_t)tf->tf_a0, tf->tf_a1, &retval);
+	    break;
+
+	    case SYS_sysbatch_setup:
+		err = sys_sysbatch_setup((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_sysbatch_enter:
+		err = sys_sysbatch_enter(tf->tf_a0, &retval);
+		break;
+
+	    case SYS_spawn:
+		err = sys_spawn((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+				(userptr_t)tf->tf_a2, tf->tf_a3, &retval);
+		break;
+
+#if OPT_SYSCALLSTAT
+	    case SYS_syscallstat:
+		err = sys_syscallstat(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+#else
+	    case SYS_syscallstat:
+		/* Not kept; no need to complain about it */
+		err = ENOSYS;
+		break;
+#endif
+
 	    default:
 		kprintf("Unknown syscall %d\n", callno);
 		err = ENOSYS;
 		break;
 	}
 
+#if OPT_SYSCALLSTAT
+	syscallstat_record(callno, err, starttime);
+#endif
 
 	if (err) {
 		/*
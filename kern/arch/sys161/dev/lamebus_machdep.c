@@ -50,12 +50,27 @@
  */
 #define CPU_FREQUENCY 25000000 /* 25 MHz */
 
+/* Cycles per hardclock tick, and the most ticks the timer can count */
+#define TIMER_TICK	(CPU_FREQUENCY / HZ)
+#define TIMER_MAXTICKS	(0xffffffffU / TIMER_TICK)
+
+/* Wiring of LAMEbus interrupts to bits in the cause register */
+#define LAMEBUS_IRQ_BIT  0x00000400	/* all system bus slots */
+#define LAMEBUS_IPI_BIT  0x00000800	/* inter-processor interrupt */
+#define MIPS_TIMER_BIT   0x00008000	/* on-chip timer */
+
 /*
  * Access to the on-chip timer.
  *
  * The c0_count register increments on every cycle; when the value
  * matches the c0_compare register, the timer interrupt line is
- * asserted. Writing to c0_compare again clears the interrupt.
+ * asserted and c0_count starts over from 0. Writing to c0_compare
+ * again clears the interrupt.
+ *
+ * Normally c0_compare is TIMER_TICK, for a hardclock every tick. An
+ * idle cpu sets it to a multiple of TIMER_TICK instead, so when it
+ * does go off, c0_compare / TIMER_TICK is the number of ticks since
+ * the last one.
  */
 static
 void
@@ -73,6 +88,70 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+static
+uint32_t
+mips_timer_get(void)
+{
+	uint32_t count;
+
+	/* $11 == c0_compare */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $11;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
+static
+uint32_t
+mips_count_get(void)
+{
+	uint32_t count;
+
+	/* $9 == c0_count */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
+static
+void
+mips_count_set(uint32_t count)
+{
+	/* $9 == c0_count */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mtc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		:: "r" (count));
+}
+
+/*
+ * True if the timer has gone off but the interrupt hasn't been taken
+ * yet. ($13 == c0_cause.)
+ */
+static
+bool
+mips_timer_pending(void)
+{
+	uint32_t cause;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $13;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (cause));
+	return (cause & MIPS_TIMER_BIT) != 0;
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -113,7 +192,42 @@ mainbus_bootstrap(void)
 	/*
 	 * Configure the MIPS on-chip timer to interrupt HZ times a second.
 	 */
-	mips_timer_set(CPU_FREQUENCY / HZ);
+	mips_timer_set(TIMER_TICK);
+}
+
+/*
+ * Tickless idle: push the timer out as far as it goes. If it's
+ * already gone off, leave it, so we wake right up and take the tick.
+ */
+void
+mainbus_timer_stop(void)
+{
+	if (!mips_timer_pending()) {
+		mips_timer_set(TIMER_MAXTICKS * TIMER_TICK);
+	}
+}
+
+/*
+ * Go back to ticking after idling. Account for the whole ticks that
+ * have gone by and keep the fraction of the current one, so the tick
+ * stays in phase. If the timer went off in the meantime the interrupt
+ * handler will do the accounting instead.
+ */
+void
+mainbus_timer_restart(void)
+{
+	uint32_t count, ticks;
+
+	if (mips_timer_pending()) {
+		return;
+	}
+	count = mips_count_get();
+	ticks = count / TIMER_TICK;
+	mips_count_set(count - ticks * TIMER_TICK);
+	mips_timer_set(TIMER_TICK);
+	if (ticks > 0) {
+		hardclock_catchup(ticks);
+	}
 }
 
 /*
@@ -246,15 +360,10 @@ mainbus_send_ipi(struct cpu *target)
  * Interrupt dispatcher.
  */
 
-/* Wiring of LAMEbus interrupts to bits in the cause register */
-#define LAMEBUS_IRQ_BIT  0x00000400	/* all system bus slots */
-#define LAMEBUS_IPI_BIT  0x00000800	/* inter-processor interrupt */
-#define MIPS_TIMER_BIT   0x00008000	/* on-chip timer */
-
 void
 mainbus_interrupt(struct trapframe *tf)
 {
-	uint32_t cause;
+	uint32_t cause, ticks;
 
 	/* interrupts should be off */
 	KASSERT(curthread->t_curspl > 0);
@@ -268,8 +377,18 @@ mainbus_interrupt(struct trapframe *tf)
 		lamebus_clear_ipi(lamebus, curcpu);
 	}
 	else if (cause & MIPS_TIMER_BIT) {
+		/*
+		 * If we were idling with the timer pushed out, it's
+		 * been more than one tick; account for the others.
+		 * (The first time it goes off, from the arbitrary
+		 * value start.S set, it can be less than one.)
+		 */
+		ticks = mips_timer_get() / TIMER_TICK;
+		if (ticks > 1) {
+			hardclock_catchup(ticks - 1);
+		}
 		/* Reset the timer (this clears the interrupt) */
-		mips_timer_set(CPU_FREQUENCY / HZ);
+		mips_timer_set(TIMER_TICK);
 		/* and call hardclock */
 		hardclock();
 	}
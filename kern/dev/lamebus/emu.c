@@ -43,6 +43,8 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/dirent.h>
+#include <limits.h>
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
@@ -575,6 +577,73 @@ emufs_getdirentry(struct vnode *v, struct uio *uio)
 	return emu_readdir(ev->ev_emu, ev->ev_handle, amt, uio);
 }
 
+/*
+ * VOP_GETDIRENTRIES
+ *
+ * The hardware hands out one name per operation, so this saves only
+ * the system call crossings, not the device round trips. The offset
+ * is the hardware's cookie; a name that doesn't fit is read again
+ * next time.
+ */
+static
+int
+emufs_getdirentries(struct vnode *v, struct uio *uio)
+{
+	struct emufs_vnode *ev = v->vn_data;
+	struct dirent *d;
+	struct iovec iov;
+	struct uio ku;
+	size_t len, reclen;
+	off_t next;
+	unsigned count;
+	int result;
+
+	KASSERT(uio->uio_rw==UIO_READ);
+
+	d = kmalloc(DIRENT_RECLEN(NAME_MAX));
+	if (d == NULL) {
+		return ENOMEM;
+	}
+
+	result = 0;
+	for (count = 0; ; count++) {
+		uio_kinit(&iov, &ku, d->d_name, NAME_MAX, uio->uio_offset,
+			  UIO_READ);
+		result = emu_readdir(ev->ev_emu, ev->ev_handle, NAME_MAX, &ku);
+		if (result) {
+			break;
+		}
+		len = NAME_MAX - ku.uio_resid;
+		if (len == 0) {
+			/* End of directory */
+			break;
+		}
+
+		reclen = DIRENT_RECLEN(len);
+		if (reclen > uio->uio_resid) {
+			if (count == 0) {
+				result = EINVAL;
+			}
+			break;
+		}
+		bzero((char *)d->d_name + len, reclen - sizeof(*d) - len);
+		d->d_ino = 0;
+		d->d_reclen = reclen;
+		d->d_type = DT_UNKNOWN;
+		d->d_namlen = len;
+
+		next = ku.uio_offset;
+		result = uiomove(d, reclen, uio);
+		uio->uio_offset = next;
+		if (result) {
+			break;
+		}
+	}
+
+	kfree(d);
+	return result;
+}
+
 /*
  * VOP_WRITE
  */
@@ -1083,6 +1152,7 @@ static const struct vnode_ops emufs_fileops = {
 	emufs_read,
 	emufs_readlink_notlink,
 	emufs_uio_op_notdir, /* getdirentry */
+	emufs_uio_op_notdir, /* getdirentries */
 	emufs_write,
 	emufs_ioctl,
 	emufs_stat,
@@ -1118,6 +1188,7 @@ static const struct vnode_ops emufs_dirops = {
 	emufs_uio_op_isdir,   /* read */
 	emufs_uio_op_isdir,   /* readlink */
 	emufs_getdirentry,
+	emufs_getdirentries,
 	emufs_uio_op_isdir,   /* write */
 	emufs_ioctl,
 	emufs_stat,
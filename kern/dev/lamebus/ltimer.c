@@ -85,16 +85,15 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 
 	/*
 	 * We do, however, use ltimer for the timer clock, since the
-	 * on-chip timer can't do that.
+	 * on-chip timer can't do that. It's used as a one-shot, set
+	 * by the timer wheel for whenever it next has work to do.
 	 */
 	if (!havetimerclock) {
 		havetimerclock = true;
 		lt->lt_timerclock = 1;
 
-		/* Wire it to go off once every second. */
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 1);
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT,
-				   LT_GRANULARITY);
+		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 0);
+		timerclock_attach(lt, ltimer_settimer);
 	}
 	
 	return 0;
@@ -127,6 +126,22 @@ ltimer_irq(void *vlt)
 	}
 }
 
+/*
+ * Start the countdown timer; it interrupts once, USECS microseconds
+ * from now. Writing the count register restarts the countdown, so
+ * this replaces any earlier setting.
+ */
+void
+ltimer_settimer(void *vlt, uint32_t usecs)
+{
+	struct ltimer_softc *lt = vlt;
+
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT, usecs);
+}
+
 /*
  * The timer device will beep if you write to the beep register. It
  * doesn't matter what value you write. This function is called if
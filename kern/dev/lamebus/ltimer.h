@@ -51,5 +51,7 @@ void ltimer_irq(/*struct ltimer_softc*/ void *lt);  // interrupt handler
 void ltimer_beep(/*struct ltimer_softc*/ void *devdata);   // for beep device
 void ltimer_gettime(/*struct ltimer_softc*/ void *devdata,
 		    time_t *secs, uint32_t *nsecs);       // for rtclock
+void ltimer_settimer(/*struct ltimer_softc*/ void *devdata,
+		     uint32_t usecs);                     // for timerclock
 
 #endif /* _LAMEBUS_LTIMER_H_ */
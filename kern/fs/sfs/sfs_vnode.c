@@ -35,6 +35,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/dirent.h>
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
@@ -44,6 +45,7 @@
 #include <vfs.h>
 #include <device.h>
 #include <sfs.h>
+#include "opt-sfscheck.h"
 
 /* At bottom of file */
 static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
@@ -890,7 +892,7 @@ sfs_reclaim(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = v->vn_fs->fs_data;
-	unsigned ix, i, num;
+	struct sfs_vnode **svp;
 	int result;
 
 	vfs_biglock_acquire();
@@ -932,21 +934,16 @@ sfs_reclaim(struct vnode *v)
 	}
 
 	/* Remove the vnode structure from the table in the struct sfs_fs. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	ix = num;
-	for (i=0; i<num; i++) {
-		struct vnode *v2 = vnodearray_get(sfs->sfs_vnodes, i);
-		struct sfs_vnode *sv2 = v2->vn_data;
-		if (sv2 == sv) {
-			ix = i;
-			break;
+	svp = &sfs->sfs_vhash[SFS_VHASH(sv->sv_ino)];
+	while (*svp != sv) {
+		if (*svp == NULL) {
+			panic("sfs: reclaim vnode %u not in vnode pool\n",
+			      sv->sv_ino);
 		}
+		svp = &(*svp)->sv_hashnext;
 	}
-	if (ix == num) {
-		panic("sfs: reclaim vnode %u not in vnode pool\n",
-		      sv->sv_ino);
-	}
-	vnodearray_remove(sfs->sfs_vnodes, ix);
+	*svp = sv->sv_hashnext;
+	sfs->sfs_nvnodes--;
 
 	VOP_CLEANUP(&sv->sv_v);
 
@@ -997,6 +994,111 @@ sfs_write(struct vnode *v, struct uio *uio)
 	return result;
 }
 
+/*
+ * Called for getdirentries(). Reads the directory a block at a time
+ * and packs the used slots into the caller's buffer. The offset is the
+ * slot number to start from.
+ *
+ * The type of an entry lives in its inode, which we don't load here,
+ * so everything but . and .. comes back as DT_UNKNOWN.
+ */
+static
+int
+sfs_getdirentries(struct vnode *v, struct uio *uio)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_dir *sds;
+	struct dirent *d;
+	struct iovec iov;
+	struct uio ku;
+	const unsigned perblock = SFS_BLOCKSIZE / sizeof(struct sfs_dir);
+	unsigned slot, nentries, first, n, i, count;
+	size_t len, reclen;
+	int result;
+
+	KASSERT(uio->uio_rw==UIO_READ);
+
+	sds = kmalloc(SFS_BLOCKSIZE);
+	d = kmalloc(DIRENT_RECLEN(SFS_NAMELEN));
+	if (sds == NULL || d == NULL) {
+		kfree(sds);
+		kfree(d);
+		return ENOMEM;
+	}
+
+	vfs_biglock_acquire();
+
+	nentries = sfs_dir_nentries(sv);
+	slot = uio->uio_offset;
+	count = 0;
+	result = 0;
+
+	while (slot < nentries) {
+		/* Read the rest of the block SLOT is in */
+		first = slot;
+		n = perblock - first % perblock;
+		if (n > nentries - first) {
+			n = nentries - first;
+		}
+		uio_kinit(&iov, &ku, sds, n * sizeof(struct sfs_dir),
+			  first * sizeof(struct sfs_dir), UIO_READ);
+		result = sfs_io(sv, &ku);
+		if (result) {
+			break;
+		}
+		if (ku.uio_resid > 0) {
+			panic("sfs: getdirentries: Short entry (inode %u)\n",
+			      sv->sv_ino);
+		}
+
+		for (i=0; i<n; i++) {
+			if (sds[i].sfd_ino == SFS_NOINO) {
+				slot++;
+				continue;
+			}
+
+			/* Ensure null termination, just in case */
+			sds[i].sfd_name[sizeof(sds[i].sfd_name)-1] = 0;
+			len = strlen(sds[i].sfd_name);
+			reclen = DIRENT_RECLEN(len);
+			if (reclen > uio->uio_resid) {
+				if (count == 0) {
+					result = EINVAL;
+				}
+				goto done;
+			}
+
+			bzero(d, reclen);
+			d->d_ino = sds[i].sfd_ino;
+			d->d_reclen = reclen;
+			d->d_namlen = len;
+			if (!strcmp(sds[i].sfd_name, ".") ||
+			    !strcmp(sds[i].sfd_name, "..")) {
+				d->d_type = DT_DIR;
+			}
+			else {
+				d->d_type = DT_UNKNOWN;
+			}
+			memcpy(d->d_name, sds[i].sfd_name, len);
+
+			result = uiomove(d, reclen, uio);
+			if (result) {
+				goto done;
+			}
+			slot++;
+			count++;
+		}
+	}
+
+ done:
+	vfs_biglock_release();
+
+	uio->uio_offset = slot;
+	kfree(d);
+	kfree(sds);
+	return result;
+}
+
 /*
  * Called for ioctl()
  */
@@ -1039,6 +1141,9 @@ sfs_stat(struct vnode *v, struct stat *statbuf)
 	statbuf->st_nlink = 0;
 	statbuf->st_blocks = 0;
 
+	/* Whole blocks can be written without reading them first */
+	statbuf->st_blksize = SFS_BLOCKSIZE;
+
 	/* Fill in other field as desired/possible... */
 
 	return 0;
@@ -1585,6 +1690,7 @@ static const struct vnode_ops sfs_fileops = {
 	sfs_read,
 	NOTDIR,  /* readlink */
 	NOTDIR,  /* getdirentry */
+	NOTDIR,  /* getdirentries */
 	sfs_write,
 	sfs_ioctl,
 	sfs_stat,
@@ -1620,6 +1726,7 @@ static const struct vnode_ops sfs_dirops = {
 	ISDIR,   /* read */
 	ISDIR,   /* readlink */
 	UNIMP,   /* getdirentry */
+	sfs_getdirentries,
 	ISDIR,   /* write */
 	sfs_ioctl,
 	sfs_stat,
@@ -1642,6 +1749,30 @@ static const struct vnode_ops sfs_dirops = {
 	sfs_lookparent,
 };
 
+#if OPT_SFSCHECK
+/*
+ * Consistency check: every inode in memory must be in an allocated
+ * block. This looks at every loaded vnode, so it's only done in
+ * kernels built with the sfscheck option.
+ */
+static
+void
+sfs_checkvnodes(struct sfs_fs *sfs)
+{
+	struct sfs_vnode *sv;
+	unsigned i;
+
+	for (i=0; i<SFS_VHASHSIZE; i++) {
+		for (sv = sfs->sfs_vhash[i]; sv != NULL; sv = sv->sv_hashnext) {
+			if (!sfs_bused(sfs, sv->sv_ino)) {
+				panic("sfs: Found inode %u in unallocated "
+				      "block\n", sv->sv_ino);
+			}
+		}
+	}
+}
+#endif
+
 /*
  * Function to load a inode into memory as a vnode, or dig up one
  * that's already resident.
@@ -1651,26 +1782,18 @@ int
 sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		 struct sfs_vnode **ret)
 {
-	struct vnode *v;
 	struct sfs_vnode *sv;
 	const struct vnode_ops *ops = NULL;
-	unsigned i, num;
+	unsigned bucket;
 	int result;
 
-	/* Look in the vnodes table */
-	num = vnodearray_num(sfs->sfs_vnodes);
-
-	/* Linear search. Is this too slow? You decide. */
-	for (i=0; i<num; i++) {
-		v = vnodearray_get(sfs->sfs_vnodes, i);
-		sv = v->vn_data;
-
-		/* Every inode in memory must be in an allocated block */
-		if (!sfs_bused(sfs, sv->sv_ino)) {
-			panic("sfs: Found inode %u in unallocated block\n",
-			      sv->sv_ino);
-		}
+#if OPT_SFSCHECK
+	sfs_checkvnodes(sfs);
+#endif
 
+	/* Look in the vnodes table */
+	bucket = SFS_VHASH(ino);
+	for (sv = sfs->sfs_vhash[bucket]; sv != NULL; sv = sv->sv_hashnext) {
 		if (sv->sv_ino==ino) {
 			/* Found */
 
@@ -1744,12 +1867,9 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	sv->sv_ino = ino;
 
 	/* Add it to our table */
-	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_v, NULL);
-	if (result) {
-		VOP_CLEANUP(&sv->sv_v);
-		kfree(sv);
-		return result;
-	}
+	sv->sv_hashnext = sfs->sfs_vhash[bucket];
+	sfs->sfs_vhash[bucket] = sv;
+	sfs->sfs_nvnodes++;
 
 	/* Hand it back */
 	*ret = sv;
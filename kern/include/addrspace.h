@@ -47,6 +47,16 @@ struct cpu;
 //Declaring the same number of stack pages as now of now -- might change later
 #define VM_STACKPAGES    12
 
+/*
+ * Anonymous mappings (mmap) are placed from MMAP_BASE up towards the
+ * stack; sbrk keeps the heap below MMAP_BASE.
+ */
+#define MMAP_BASE	0x40000000
+
+/* Region types */
+#define REGION_LOAD	0	/* defined by the executable */
+#define REGION_ANON	1	/* anonymous mapping, from mmap */
+
 struct page_table_entry
 {
 	paddr_t pa;			//Stores the physical address to which page is mapped
@@ -74,6 +84,7 @@ struct addr_regions
 	vaddr_t va_end;				//Virtual address of the end of region
 
 	int region_numpages;		//Number of pages assigned for the region
+	int region_type;		//REGION_LOAD or REGION_ANON
 
 	//Permissions -- Set to 1 if permission given and 0 if permission not given
 
@@ -173,6 +184,20 @@ int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 void			  as_zero_region(paddr_t paddr, unsigned npages);
 
+/*
+ * as_map_anon - make an anonymous region of LEN bytes with permissions
+ *               PROT (PROT_* bits) at an address of the kernel's
+ *               choosing, handed back in *VADDR. Its pages are
+ *               zero-filled on first touch.
+ *
+ * as_unmap    - remove the LEN bytes of anonymous regions at VADDR,
+ *               freeing their pages. Parts of the range not in an
+ *               anonymous region are left alone.
+ */
+int               as_map_anon(struct addrspace *as, size_t len, int prot,
+                              vaddr_t *vaddr);
+int               as_unmap(struct addrspace *as, vaddr_t vaddr, size_t len);
+
 /*paddr_t alloc_newPage(struct addrspace *new,int *index,struct addrspace *old);*/
 paddr_t alloc_newPage(struct addrspace *new);
 
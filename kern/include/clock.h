@@ -35,11 +35,16 @@
 /*
  * Time-related definitions.
  *
- * hardclock() is called on every CPU HZ times a second, possibly only
- * when the CPU is not idle, for scheduling.
+ * hardclock() is called on every CPU HZ times a second, but only
+ * when the CPU is not idle, for scheduling. An idle CPU calls
+ * hardclock_idle() to halt with its tick stopped, unless other CPUs
+ * have threads waiting that it may yet steal; the MD timer code
+ * reports the ticks it missed with hardclock_catchup().
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU by the timer device whenever the
+ * countdown set with timerclock_set() runs out. It runs the timer
+ * wheel in <timeout.h>, which is what timed operations should use.
+ * The device registers itself with timerclock_attach().
  *
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
@@ -56,10 +61,30 @@
 #define HZ  100
 #endif
 
+/*
+ * Load averages are kept per cpu as fixed-point numbers with
+ * LOADAVG_FSHIFT fractional bits, and recomputed every
+ * LOADAVG_HARDCLOCKS hardclocks (5 seconds).
+ */
+#define LOADAVG_FSHIFT		11
+#define LOADAVG_FSCALE		(1 << LOADAVG_FSHIFT)
+#define LOADAVG_HARDCLOCKS	(5 * HZ)
+
+/* Time slice: a running thread is preempted after this many hardclocks */
+#define SLICE_HARDCLOCKS	4
+
+/* Convert hardclocks to microseconds */
+#define HARDCLOCKS_TO_USEC(n)	((uint64_t)(n) * (1000000 / HZ))
+
 void hardclock_bootstrap(void);
 
 void hardclock(void);
+void hardclock_catchup(unsigned ticks);
+void hardclock_idle(void);
+
 void timerclock(void);
+void timerclock_attach(void *devdata, void (*settimer)(void *, uint32_t));
+bool timerclock_set(uint32_t usecs);
 
 void gettime(time_t *seconds, uint32_t *nanoseconds);
 
@@ -70,8 +95,10 @@ void getinterval(time_t secs1, uint32_t nsecs,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ * clocksleep_ticks() does the same for a number of hardclock ticks.
  */
 void clocksleep(int seconds);
+void clocksleep_ticks(unsigned ticks);
 
 
 #endif /* _CLOCK_H_ */
@@ -60,6 +60,24 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_busyclocks;		/* hardclocks spent running threads */
+	unsigned c_idleclocks;		/* hardclocks spent idle */
+	unsigned c_loadavg[3];		/* 1/5/15 min load, LOADAVG_FSCALE */
+	unsigned c_slice;		/* hardclocks left in curthread's slice */
+	struct threadlist c_threadpool;	/* Reaped threads kept for reuse */
+	unsigned c_threadpool_hits;	/* thread_fork reused a pooled thread */
+	unsigned c_threadpool_misses;	/* thread_fork found the pool empty */
+
+	/*
+	 * Scheduler placement statistics.
+	 * Updated only by this cpu; read unlocked for reporting.
+	 */
+	unsigned c_steal_cold;		/* Stole a cache-cold thread */
+	unsigned c_steal_hot;		/* Stole a cache-hot thread */
+	unsigned c_steal_declined;	/* Victim's threads were all hot */
+	unsigned c_wake_hot;		/* Woke cache-hot thread in place */
+	unsigned c_wake_home;		/* Woke cold thread; home cpu best */
+	unsigned c_wake_moved;		/* Woke cold thread on another cpu */
 
 	/*
 	 * Accessed by other cpus.
@@ -86,6 +104,7 @@ struct cpu {
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	int c_numshootdown;
+	unsigned c_shootdowns_done;	/* IPI_TLBSHOOTDOWNs handled */
 	struct spinlock c_ipi_lock;
 };
 
@@ -166,6 +185,7 @@ void cpu_halt(void);
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+void ipi_tlbshootdown_sync(const struct tlbshootdown *mapping);
 
 void interprocessor_interrupt(void);
 
@@ -0,0 +1,101 @@
+#ifndef _FDTABLE_H_
+#define _FDTABLE_H_
+
+#include <spinlock.h>
+
+/*
+ * Open files and file descriptor tables.
+ *
+ * An open file (struct openfile) is made by each successful open. It
+ * holds the vnode, the access mode and the seek offset, and it is
+ * shared by every file descriptor that refers to it in any process:
+ * dup2 and fork add references, and close drops them. The file is
+ * closed when the last reference goes away. of_lock serializes I/O
+ * that uses or updates the offset.
+ *
+ * Each process has an fd table mapping its descriptors to open files.
+ * It is shared by the process's threads. The table starts small and
+ * doubles as needed, up to OPEN_MAX. A bitmap of the fds in use, and
+ * a hint below which no fd is free, make finding the lowest free fd
+ * quick. fdt_lock is a spinlock, held only to look things up or
+ * change them, never across I/O.
+ */
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_accmode;			/* O_RDONLY, O_WRONLY or O_RDWR */
+	bool of_append;			/* O_APPEND: writes go at the end */
+	struct lock *of_lock;		/* covers of_offset */
+	off_t of_offset;
+	struct spinlock of_reflock;	/* covers of_refcount */
+	unsigned of_refcount;
+};
+
+struct fdtable {
+	struct spinlock fdt_lock;
+	unsigned fdt_size;		/* number of fds with room */
+	unsigned fdt_lowfree;		/* no free fd below this */
+	struct openfile **fdt_files;	/* fdt_size entries */
+	uint32_t *fdt_inuse;		/* bitmap, fdt_size bits */
+};
+
+/*
+ * Make an open file for VN, opened with FLAGS, with one reference.
+ * Returns NULL if out of memory. The reference to VN is the open
+ * file's from then on.
+ */
+struct openfile *openfile_create(struct vnode *vn, int flags);
+
+/* Add or drop a reference. The last drop closes the vnode. */
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+/* Make an empty table, or NULL if out of memory. */
+struct fdtable *fdtable_create(void);
+
+/* Drop all the table's open files and free it. */
+void fdtable_destroy(struct fdtable *fdt);
+
+/* Fill the empty table DST with references to what SRC has open. */
+int fdtable_copy(struct fdtable *src, struct fdtable *dst);
+
+/*
+ * Install OF at the lowest free fd and return the fd in *FD. The
+ * caller's reference to OF goes to the table. EMFILE if full.
+ */
+int fdtable_alloc(struct fdtable *fdt, struct openfile *of, int *fd);
+
+/*
+ * Get the open file for FD, with a reference the caller must drop
+ * with openfile_decref. EBADF if FD isn't open.
+ */
+int fdtable_get(struct fdtable *fdt, int fd, struct openfile **ret);
+
+/*
+ * Take FD out of the table and hand back the table's reference to
+ * its open file. EBADF if FD isn't open.
+ */
+int fdtable_remove(struct fdtable *fdt, int fd, struct openfile **ret);
+
+/*
+ * Install OF at FD. The caller's reference to OF goes to the table.
+ * If FD was open, the table's reference to what it had is handed back
+ * in *OLDOF (else NULL) for the caller to drop. EBADF if FD is out of
+ * range.
+ */
+int fdtable_install(struct fdtable *fdt, int fd, struct openfile *of,
+		    struct openfile **oldof);
+
+/*
+ * Make NEWFD refer to what OLDFD does. If NEWFD was open, the table's
+ * reference to what it had is handed back in *OLDOF (else NULL) for
+ * the caller to drop. EBADF if OLDFD isn't open or NEWFD is out of
+ * range.
+ */
+int fdtable_dup2(struct fdtable *fdt, int oldfd, int newfd,
+		 struct openfile **oldof);
+
+#endif /* _FDTABLE_H_ */
@@ -9,29 +9,26 @@
 #define FILE_SYSCALL_H_
 
 
-struct vnode;
-struct lock;
-
-struct file_descriptor{
-	char *f_name;
-	int f_flag;
-	off_t f_offset;
-	struct lock *f_lock;
-	struct vnode *f_object;
-	int reference_count;
-};
-
-int intialize_file_desc_tbl(struct file_descriptor *file_table[]);
-struct file_descriptor* intialize_file_desc_con(struct vnode *v, int index, char *file_name, int open_type);
-struct file_descriptor* file_descriptor_init(char *name);
-void file_descriptor_cleanup(struct file_descriptor *fd);
+struct fdtable;
+
+int intialize_file_desc_tbl(struct fdtable *fdt);
 int sys_open(userptr_t filename, int flags, int *return_val);
 int sys_close(int fd);
+int sys_pipe(userptr_t fds);
 int sys_read(int fd, userptr_t buf, size_t buflen, int *return_value);
 int sys_write(int fd, userptr_t buf, size_t nbytes, int *return_value);
+int sys_pread(int fd, userptr_t buf, size_t buflen, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t nbytes, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_copy_file_range(int infd, userptr_t inoff, int outfd, userptr_t outoff,
+			size_t len, unsigned flags, int *retval);
+int sys_getdirentries(int fd, userptr_t buf, size_t buflen, userptr_t basep,
+		      int *retval);
 int dup2(int oldfd, int newfd, int *return_value);
 int __getcwd(userptr_t buf, size_t buflen, int *return_value);
 int chdir(userptr_t pathname);
+int file_lseek(int fd, off_t pos, int whence, off_t *newpos);
 int lseek(int fd, off_t pos, int32_t whence, int32_t *return_value1, int32_t *return_value2);
 
 
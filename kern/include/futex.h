@@ -0,0 +1,25 @@
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+/*
+ * Futexes: blocking for user-level synchronization.
+ *
+ * A futex is just an aligned int in user memory. User code does its
+ * locking with atomic operations on the word and only calls into the
+ * kernel when it has to wait: futex_wait sleeps if the word still
+ * holds the value the caller last saw, and futex_wake wakes threads
+ * sleeping on the word. Sleepers are kept in a hash table keyed by
+ * (address space, virtual address), so the word doesn't need any
+ * kernel state until somebody waits on it.
+ *
+ * A futex_wait may return 0 without a matching futex_wake; callers
+ * must always recheck the word.
+ */
+
+/* Setup, called from boot. */
+void futex_bootstrap(void);
+
+int sys_futex_wait(userptr_t uaddr, int val);
+int sys_futex_wake(userptr_t uaddr, int count, int32_t *retval);
+
+#endif /* _FUTEX_H_ */
@@ -0,0 +1,34 @@
+#ifndef _KERN_DIRENT_H_
+#define _KERN_DIRENT_H_
+
+/*
+ * Directory entries as returned by getdirentries.
+ *
+ * The buffer is filled with records packed one after another, each
+ * d_reclen bytes long; step from one to the next by adding d_reclen.
+ * d_name is NUL-terminated. d_ino is 0 and d_type DT_UNKNOWN when the
+ * filesystem can't tell without looking the name up.
+ */
+
+struct dirent {
+	__u32 d_ino;		/* inode number */
+	__u16 d_reclen;		/* length of this record */
+	__u8 d_type;		/* DT_ type */
+	__u8 d_namlen;		/* length of d_name, not counting the NUL */
+	char d_name[];		/* the name */
+};
+
+/* Record length for a name of N characters: header, name, NUL, padding */
+#define DIRENT_RECLEN(n) \
+	((sizeof(struct dirent) + (n) + 1 + 3) & ~(size_t)3)
+
+/* Types */
+#define DT_UNKNOWN	0
+#define DT_REG		1	/* regular file */
+#define DT_DIR		2	/* directory */
+#define DT_LNK		3	/* symbolic link */
+#define DT_FIFO		4	/* pipe */
+#define DT_CHR		5	/* character device */
+#define DT_BLK		6	/* block device */
+
+#endif /* _KERN_DIRENT_H_ */
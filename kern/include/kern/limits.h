@@ -72,7 +72,10 @@
 #define __PIPE_BUF      512
 
 /* Max value for a processes (Maximum number of user process that can run) */
-#define __PROCESS_MAX       512
+#define __PROCESS_MAX       4096
+
+/* Max threads in one process, counting ones that exited but aren't joined */
+#define __THREAD_MAX    16
 
 /**
  * Declare max number for array of swap space
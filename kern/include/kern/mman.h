@@ -0,0 +1,23 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Constants for mmap and munmap (<sys/mman.h>).
+ *
+ * Only anonymous private mappings are supported: MAP_ANON|MAP_PRIVATE,
+ * with fd -1 and offset 0. The kernel picks the address; the pages are
+ * zero-filled the first time they are touched.
+ */
+
+/* Protection */
+#define PROT_NONE	0
+#define PROT_READ	1
+#define PROT_WRITE	2
+#define PROT_EXEC	4
+
+/* Flags */
+#define MAP_SHARED	0x0001	/* changes are shared (unsupported) */
+#define MAP_PRIVATE	0x0002	/* changes are private */
+#define MAP_ANON	0x1000	/* no file; zero-filled */
+
+#endif /* _KERN_MMAN_H_ */
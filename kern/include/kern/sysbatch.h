@@ -0,0 +1,71 @@
+#ifndef _KERN_SYSBATCH_H_
+#define _KERN_SYSBATCH_H_
+
+/*
+ * Batched system calls.
+ *
+ * A process registers a ring in its own memory with sysbatch_setup.
+ * The ring is a header followed by SB_ENTRIES submission entries and
+ * then SB_ENTRIES completion entries. To run calls, fill in sqes at
+ * sb_sqtail and advance it, then call sysbatch_enter; the kernel
+ * works through the sqes from sb_sqhead, posts a cqe for each at
+ * sb_cqtail, and advances both. Take completions from sb_cqhead.
+ *
+ * The head and tail indexes run freely and wrap; the slot for index I
+ * is I & (SB_ENTRIES-1). The kernel stops when the completion ring is
+ * full, so leave room there.
+ *
+ * Supported calls, and the sqe fields they use:
+ *    SYS_read, SYS_write   sqe_fd, sqe_addr, sqe_len
+ *    SYS_lseek             sqe_fd, sqe_off, sqe_flags (whence)
+ *    SYS_open              sqe_addr (path), sqe_flags
+ *    SYS_close             sqe_fd
+ * cqe_res gets what the call would have returned (the new offset for
+ * lseek), or -1 with the error in cqe_err. If a cqe can't be written
+ * back, sysbatch_enter fails with that error; the call it belonged to
+ * has still run and its sqe is consumed, but it has no completion.
+ */
+
+/* Largest ring allowed; must be a power of two */
+#define SYSBATCH_MAX	1024
+
+struct sysbatch_sqe {
+	__i64 sqe_off;		/* lseek offset */
+	__i32 sqe_op;		/* SYS_ number */
+	__i32 sqe_fd;		/* file handle */
+#ifdef _KERNEL
+	userptr_t sqe_addr;	/* buffer or pathname */
+#else
+	void *sqe_addr;		/* buffer or pathname */
+#endif
+	__u32 sqe_len;		/* buffer length */
+	__i32 sqe_flags;	/* open flags or lseek whence */
+	__u32 sqe_data;		/* caller's cookie, copied to the cqe */
+};
+
+struct sysbatch_cqe {
+	__i64 cqe_res;		/* result, or -1 */
+	__i32 cqe_err;		/* errno if cqe_res is -1, else 0 */
+	__u32 cqe_data;		/* sqe_data of the call */
+};
+
+struct sysbatch_ring {
+	__u32 sb_entries;	/* ring size; set by sysbatch_setup */
+	__u32 sb_sqhead;	/* next sqe to run; kernel advances */
+	__u32 sb_sqtail;	/* next free sqe; caller advances */
+	__u32 sb_cqhead;	/* next cqe to take; caller advances */
+	__u32 sb_cqtail;	/* next cqe to post; kernel advances */
+	__u32 sb_unused;
+	struct sysbatch_sqe sb_sqes[];	/* then sb_entries cqes */
+};
+
+/* Bytes of memory for a ring of N entries */
+#define SYSBATCH_SIZE(n) \
+	(sizeof(struct sysbatch_ring) + \
+	 (n) * (sizeof(struct sysbatch_sqe) + sizeof(struct sysbatch_cqe)))
+
+/* Completion entries of RING */
+#define SYSBATCH_CQES(ring) \
+	((struct sysbatch_cqe *)((ring)->sb_sqes + (ring)->sb_entries))
+
+#endif /* _KERN_SYSBATCH_H_ */
@@ -0,0 +1,27 @@
+#ifndef _KERN_SYSCALLSTAT_H_
+#define _KERN_SYSCALLSTAT_H_
+
+/*
+ * Per-syscall statistics, as returned by syscallstat(). Only kept if
+ * the kernel was built with "options syscallstat".
+ *
+ * Times are nanoseconds from when the dispatcher starts a call to
+ * when the call returns to it; calls that don't return (_exit, and
+ * execv when it works) aren't counted. ss_hist[i] counts calls that
+ * took from 2^i up to 2^(i+1) ns (the first bucket also holds 0 and
+ * 1, the last everything longer).
+ */
+
+/* Calls numbered from 0 up to this are counted */
+#define SYSCALLSTAT_NCALLS	160
+
+#define SYSCALLSTAT_BUCKETS	32
+
+struct syscallstat {
+	__u64 ss_calls;		/* times called */
+	__u64 ss_errors;	/* of those, times it failed */
+	__u64 ss_nsecs;		/* total time */
+	__u32 ss_hist[SYSCALLSTAT_BUCKETS];	/* log2 latency histogram */
+};
+
+#endif /* _KERN_SYSCALLSTAT_H_ */
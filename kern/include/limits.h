@@ -52,6 +52,7 @@
  * Author Pratham Malik
  */
 #define PROCESS_MAX         __PROCESS_MAX
+#define THREAD_MAX          __THREAD_MAX
 #define SWAP_MAX            __SWAP_MAX
 
 #endif /* _LIMITS_H_ */
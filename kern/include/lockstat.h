@@ -0,0 +1,51 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+#include "opt-lockstat.h"
+
+/*
+ * Lock contention statistics, compiled in with "options lockstat".
+ *
+ * Every spinlock and sleep lock acquisition is counted against a
+ * record for the lock's name, so e.g. all the cpus' run queue locks
+ * add up under "runqueue". Each record keeps the number of
+ * acquisitions, how many of those had to wait, the total and longest
+ * wait, and the total and longest hold time. Times are nanoseconds
+ * from gettime(); collection starts once the clock is attached.
+ *
+ * Spinlocks that were never given a name are counted together under
+ * "(unnamed)". There is room for LOCKSTAT_MAX names; anything past
+ * that goes under "(other)".
+ */
+
+#if OPT_LOCKSTAT
+
+struct lockstat;
+
+/* Current time in ns, or 0 if statistics aren't being collected. */
+uint64_t lockstat_now(void);
+
+/* Find or make the record for NAME. SPIN says what kind of lock. */
+struct lockstat *lockstat_lookup(const char *name, bool spin);
+
+/*
+ * Record an acquisition at time NOW (from lockstat_now). If the lock
+ * was contended, WAITSTART is when the wait began. Record a release
+ * at NOW of a hold that began at ACQTIME. Call with interrupts off.
+ */
+void lockstat_acquire(struct lockstat *ls, bool contended,
+		      uint64_t waitstart, uint64_t now);
+void lockstat_release(struct lockstat *ls, uint64_t acqtime, uint64_t now);
+
+/* Start collecting; called once the clock is attached. */
+void lockstat_bootstrap(void);
+
+/* Zero all the counts. */
+void lockstat_reset(void);
+
+/* Print the records with any acquisitions, most total wait first. */
+void lockstat_print(void);
+
+#endif /* OPT_LOCKSTAT */
+
+#endif /* _LOCKSTAT_H_ */
@@ -55,6 +55,14 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Stop the current cpu's periodic hardclock interrupt while it idles,
+ * and start it again afterwards. Ticks missed in between are passed
+ * to hardclock_catchup(). Called with interrupts off.
+ */
+void mainbus_timer_stop(void);
+void mainbus_timer_restart(void);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
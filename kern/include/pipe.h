@@ -0,0 +1,29 @@
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+/*
+ * Pipes.
+ *
+ * A pipe is a ring buffer with two vnodes on it, one for each end.
+ * Neither end is in any filesystem's namespace; they exist only as
+ * open files, and the pipe goes away when both have been reclaimed.
+ *
+ * A read takes whatever data is there, up to what was asked for, and
+ * sleeps only if the pipe is empty; it returns 0 (EOF) once the pipe
+ * is empty and the write end is closed. A write sleeps whenever the
+ * pipe is full until it has put all its data in, and fails with EPIPE
+ * if the read end is closed before any of it was taken.
+ */
+
+struct vnode;
+
+/* Default ring size */
+#define PIPE_BUFSIZE	PAGE_SIZE
+
+/*
+ * Make a pipe with a SIZE-byte ring and hand back its read and write
+ * ends, each opened once, for the caller to vfs_close.
+ */
+int pipe_create(size_t size, struct vnode **rvn, struct vnode **wvn);
+
+#endif /* _PIPE_H_ */
@@ -10,16 +10,29 @@ struct trapframe;
 struct thread;
 
 /**
- * Declared array for pid tracking
+ * The process table. pid_lock covers allocating and freeing pids;
+ * proc_get looks a pid up without it.
  */
-extern struct process_control *process_array[PROCESS_MAX];
 extern struct lock *pid_lock;
+/*
+ * A thread of a process. The slot's index is the thread id; the
+ * initial thread is tid 0. A slot stays in use after its thread exits,
+ * holding the return value, until another thread joins it.
+ */
+struct proc_thread
+{
+	struct thread *pt_thread;	/* NULL once the thread has exited */
+	bool pt_used;			/* slot taken */
+	int pt_retval;			/* value passed to threadexit */
+};
+
 /**
 * Structure for Process Control
 */
 struct process_control
 {
 	/* process pid */
+	pid_t p_pid;
 
 	pid_t parent_id;
 	bool exit_status;
@@ -27,22 +40,40 @@ struct process_control
 
 	struct thread *mythread;
 
-	//Child Process
-	struct child_process *childlist;
+	//Child processes, linked through p_sibling. The links, parent_id
+	//and exit_status are under pid_lock; p_child_cv (also used with
+	//pid_lock) is signalled when one of our children exits.
+	struct process_control *p_children;
+	struct process_control *p_sibling;
+	struct cv *p_child_cv;
 
-	//Semaphore to synchronize the the exit status
-	struct semaphore *process_sem;
-
-	bool waitstatus;
 	struct lock *process_lock;
-	struct cv *process_cv;
+
+	//CPU accounting: our own totals as of exit, and those of reaped children
+	struct thread_usage exit_usage;
+	struct thread_usage child_usage;
+
+	//Threads. The process exits when p_nthreads drops to zero; _exit
+	//only records the status. Slots and counts are under process_lock,
+	//and p_join_cv is signalled whenever a thread exits.
+	struct proc_thread p_threads[THREAD_MAX];
+	unsigned p_nthreads;
+	bool p_exitset;
+	struct cv *p_join_cv;
+
+	//Batched syscall ring registered with sysbatch_setup, or NULL
+	userptr_t p_sbring;
+	unsigned p_sbentries;
 };
 
-struct child_process{
+void
+proc_bootstrap(void);
 
-	pid_t child_pid;
-	struct child_process *next;
-};
+struct process_control *
+proc_get(pid_t pid);
+
+void
+proc_addchild(pid_t parent, pid_t child);
 
 /* Function to allocate pid to the thread and initialize the contents of Process structure*/
 
@@ -69,6 +100,15 @@ sys___kwaitpid(int ,int *status,int ,int32_t *retval);
 void
 deallocate_pid(pid_t processid);
 
+int
+proc_thread_add(pid_t processid, struct thread *thr, int *tid);
+
+void
+proc_thread_drop(pid_t processid, int tid);
+
+bool
+proc_thread_exit(struct thread *thr);
+
 int
 sys___fork(struct trapframe *tf,pid_t  *returnval);
 
@@ -78,7 +118,34 @@ enter_process(void *tf,unsigned long addr);
 int
 sys___execv(char *p_name ,char ** arguments);
 
+int
+sys_spawn(userptr_t prog, userptr_t args, userptr_t fdmap, int nfds,
+	  int32_t *retval);
+
 int
 sys___sbrk(int, int *retval);
 
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	 off_t offset, int *retval);
+
+int
+sys_munmap(userptr_t addr, size_t len);
+
+int
+sys_getrusage(int who, userptr_t usage);
+
+int
+sys___threadcreate(struct trapframe *tf, userptr_t entry, userptr_t stack,
+		   int32_t *retval);
+
+int
+sys_threadexit(int retval);
+
+int
+sys___threadjoin(int tid, userptr_t status);
+
+void
+proc_printps(void);
+
 #endif /* _PSYSCALL_H_ */
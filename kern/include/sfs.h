@@ -53,14 +53,23 @@ struct sfs_vnode {
 	struct sfs_inode sv_i;		/* on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	struct sfs_vnode *sv_hashnext;  /* next in sfs_vhash chain */
 };
 
+/*
+ * Loaded vnodes are hashed by inode number. Inode numbers are block
+ * numbers, so the low bits spread them well enough.
+ */
+#define SFS_VHASHSIZE   256             /* must be a power of 2 */
+#define SFS_VHASH(ino)  ((ino) & (SFS_VHASHSIZE - 1))
+
 struct sfs_fs {
 	struct fs sfs_absfs;            /* abstract filesystem structure */
 	struct sfs_super sfs_super;	/* on-disk superblock */
 	bool sfs_superdirty;            /* true if superblock modified */
 	struct device *sfs_device;      /* device mounted on */
-	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
+	struct sfs_vnode *sfs_vhash[SFS_VHASHSIZE]; /* loaded vnodes */
+	unsigned sfs_nvnodes;           /* number of loaded vnodes */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
 };
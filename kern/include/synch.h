@@ -29,7 +29,6 @@
 
 #ifndef _SYNCH_H_
 #define _SYNCH_H_
-#define MAX_READ 500
 /*
  * Header file for synchronization primitives.
  */
@@ -69,6 +68,12 @@ void V(struct semaphore *);
  * When the lock is created, no thread should be holding it. Likewise,
  * when the lock is destroyed, no thread should be holding it.
  *
+ * The lock is adaptive: a thread that finds it held spins as long as
+ * the holder is running on another cpu, since it'll probably let go
+ * sooner than a context switch would take, and sleeps otherwise. On
+ * release the lock is handed straight to one sleeper, if there are
+ * any, rather than waking it to compete for the lock again.
+ *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
  */
@@ -77,9 +82,12 @@ struct lock {
         struct wchan *lock_wchan;
         volatile int lock_hold;
         struct spinlock lk_spinlock;
-        struct thread *lk_thread;
-        // add what you need here
-        // (don't forget to mark things volatile as needed)
+        struct thread *lk_thread;	/* holder; NULL while handed off */
+        unsigned lk_waiters;		/* threads asleep on lock_wchan */
+#if OPT_LOCKSTAT
+        struct lockstat *lk_stat;	/* statistics record */
+        uint64_t lk_acqtime;		/* when it was acquired */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -93,8 +101,6 @@ void lock_acquire(struct lock *);
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock; 
  *                   false otherwise.
- *
- * These operations must be atomic. You get to write them.
  */
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
@@ -131,6 +137,9 @@ void cv_destroy(struct cv *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_wait_timeout - Like cv_wait, but give up after the given
+ *                   number of hardclock ticks. Returns ETIMEDOUT if
+ *                   that happened, 0 otherwise.
  *
  * For all three operations, the current thread must hold the lock passed 
  * in. Note that under normal circumstances the same lock should be used
@@ -139,27 +148,51 @@ void cv_destroy(struct cv *);
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_wait_timeout(struct cv *cv, struct lock *lock, unsigned ticks);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 /*
  * 13 Feb 2012 : GWA : Reader-writer locks.
+ *
+ * Any number of readers or one writer may hold the lock. Threads
+ * that can't get it sleep; nobody spins.
+ *
+ * To keep writers from starving, a new reader waits if a writer is
+ * waiting, even though the lock is only held for reading. To keep
+ * readers from starving in turn, a writer releasing the lock lets
+ * in every reader that was waiting before it lets in another writer.
+ * Ownership is handed over directly on release, so a woken thread
+ * already holds the lock and never has to compete for it again.
  */
 
 struct rwlock {
         char *rwlock_name;
-        struct semaphore *rwlock_semaphore;
-        //struct wchan *rw_wchan;
-        //bool writer_inside;
-        struct lock *rwlock_lock;
+        struct wchan *rwlock_rwchan;		/* waiting readers */
+        struct wchan *rwlock_wwchan;		/* waiting writers */
+        struct spinlock rwlock_lock;		/* protects the rest */
+        volatile unsigned rwlock_readers;	/* readers holding it */
+        volatile unsigned rwlock_rwaiting;	/* readers asleep */
+        volatile unsigned rwlock_wwaiting;	/* writers asleep */
+        struct thread *rwlock_writer;		/* writer holding it */
 };
 
 struct rwlock * rwlock_create(const char *);
 void rwlock_destroy(struct rwlock *);
 
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock shared. Blocks while a writer
+ *                           holds it or is waiting for it.
+ *    rwlock_release_read  - Give up a shared hold.
+ *    rwlock_acquire_write - Get the lock exclusively.
+ *    rwlock_release_write - Give up the exclusive hold.
+ *    rwlock_do_i_hold_write - True if the current thread is the writer.
+ */
 void rwlock_acquire_read(struct rwlock *);
 void rwlock_release_read(struct rwlock *);
 void rwlock_acquire_write(struct rwlock *);
 void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
 
 #endif /* _SYNCH_H_ */
@@ -0,0 +1,15 @@
+#ifndef _SYSBATCH_H_
+#define _SYSBATCH_H_
+
+/*
+ * Batched system calls; the ring format is in <kern/sysbatch.h>.
+ *
+ * The registered ring belongs to the process and is forgotten on
+ * execv; a forked child starts without one. Threads sharing a ring
+ * must not call sysbatch_enter on it at the same time.
+ */
+
+int sys_sysbatch_setup(userptr_t ring, unsigned entries);
+int sys_sysbatch_enter(unsigned count, int32_t *retval);
+
+#endif /* _SYSBATCH_H_ */
@@ -0,0 +1,40 @@
+#ifndef _SYSCALLSTAT_H_
+#define _SYSCALLSTAT_H_
+
+#include "opt-syscallstat.h"
+
+/*
+ * System call statistics, compiled in with "options syscallstat".
+ *
+ * The dispatcher times every call and counts it, and whether it
+ * failed, in a per-cpu table so that cpus never contend on the
+ * counts. The tables are summed when read, from the [ss] menu command
+ * or by user programs through the syscallstat system call. The record
+ * format is in <kern/syscallstat.h>.
+ */
+
+#if OPT_SYSCALLSTAT
+
+#include <kern/syscallstat.h>
+
+/* Set up the table for a cpu; called from cpu_create. */
+void syscallstat_cpuinit(unsigned cpunum);
+
+/* Current time in ns, to pass back to syscallstat_record. */
+uint64_t syscallstat_now(void);
+
+/* Count a call that started at START and returned ERR. */
+void syscallstat_record(int callno, int err, uint64_t start);
+
+/* Zero all the counts. */
+void syscallstat_reset(void);
+
+/* Print the calls that have been made, with their histograms. */
+void syscallstat_print(void);
+
+/* The syscallstat system call: fetch the totals for CALLNO. */
+int sys_syscallstat(int callno, userptr_t stat);
+
+#endif /* OPT_SYSCALLSTAT */
+
+#endif /* _SYSCALLSTAT_H_ */
@@ -45,6 +45,7 @@
 struct addrspace;
 struct cpu;
 struct vnode;
+struct fdtable;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -70,6 +71,20 @@ typedef enum {
 
 
 
+/*
+ * CPU time and context switch accounting for a thread.
+ *
+ * Times are sampled: hardclock() charges each tick to whatever thread
+ * is running, in user or kernel mode according to where the timer
+ * interrupt came from.
+ */
+struct thread_usage {
+	unsigned tu_uclocks;		/* hardclocks spent in user mode */
+	unsigned tu_sclocks;		/* hardclocks spent in the kernel */
+	unsigned tu_nvcsw;		/* voluntary context switches */
+	unsigned tu_nivcsw;		/* involuntary context switches */
+};
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -85,9 +100,11 @@ struct thread {
 	 */
 	struct thread_machdep t_machdep; /* Any machine-dependent goo */
 	struct threadlistnode t_listnode; /* Link for run/sleep/zombie lists */
+	struct wchan *t_wchan;		/* Wait channel, if on one */
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	unsigned t_lastrun;		/* t_cpu->c_hardclocks when last run */
 
 	/*
 	 * Interrupt state fields.
@@ -103,6 +120,7 @@ struct thread {
 	 * rather than per-cpu or global?
 	 */
 	bool t_in_interrupt;		/* Are we in an interrupt? */
+	bool t_intr_from_user;		/* Interrupted in user mode? */
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
@@ -116,9 +134,13 @@ struct thread {
 	/* VFS */
 	struct vnode *t_cwd;		/* current working directory */
 
+	/* Accounting */
+	struct thread_usage t_usage;	/* CPU time and switch counts */
+
 	/* add more here as needed */
 
-	struct file_descriptor *file_table[__OPEN_MAX];
+	/* Open files; shared by the process's threads */
+	struct fdtable *file_table;
 
 
 	/*
@@ -128,6 +150,8 @@ struct thread {
 	pid_t t_pid;
 	//End of additions by PM
 
+	int t_tid;			/* Thread id within the process */
+
 };
 
 /* Call once during system startup to allocate data structures. */
@@ -157,8 +181,34 @@ int thread_fork(const char *name,
                 void *data1, unsigned long data2, 
                 struct thread **ret);
 
+/*
+ * Like thread_fork, but the new process starts with no address space
+ * rather than a copy of the caller's, for a thread that is going to
+ * load a program of its own. If FDT isn't NULL the new process gets it
+ * as its file table instead of a copy of the caller's; it belongs to
+ * the new process if this succeeds, and is still the caller's if not.
+ */
+int thread_fork_noas(const char *name,
+                     void (*func)(void *, unsigned long),
+                     void *data1, unsigned long data2,
+                     struct fdtable *fdt, struct thread **ret);
+
+/*
+ * Like thread_fork, but the new thread joins the current thread's
+ * process instead of starting a new one: it gets the same pid, and
+ * shares the address space and file table. Its thread id within the
+ * process is handed back in TID. Returns EAGAIN if the process
+ * already has THREAD_MAX threads.
+ */
+int thread_fork_sibling(const char *name,
+                        void (*func)(void *, unsigned long),
+                        void *data1, unsigned long data2,
+                        int *tid);
+
 /*
  * Cause the current thread to exit.
+ * The address space and file table go away with the last thread in
+ * the process.
  * Interrupts need not be disabled.
  */
 void thread_exit(void);
@@ -171,15 +221,30 @@ void thread_exit(void);
 void thread_yield(void);
 
 /*
- * Reshuffle the run queue. Called from the timer interrupt.
+ * Print the per-cpu scheduler placement and migration counters.
  */
-void schedule(void);
+void thread_printschedstats(void);
 
 /*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
+ * Print per-cpu busy/idle time and load averages.
  */
-void thread_consider_migration(void);
+void thread_printcpustats(void);
+
+/*
+ * Print per-cpu thread pool occupancy and hit/miss counts.
+ */
+void thread_printpoolstats(void);
+
+/*
+ * Add the counts in SRC into DEST.
+ */
+void thread_usage_add(struct thread_usage *dest,
+		      const struct thread_usage *src);
+
+/*
+ * Reshuffle the run queue. Called from the timer interrupt.
+ */
+void schedule(void);
 
 void my_tlb_shhotdown(vaddr_t tlb_vaddr);
 
@@ -0,0 +1,64 @@
+#ifndef _TIMEOUT_H_
+#define _TIMEOUT_H_
+
+/*
+ * Timeouts: call a function a given number of hardclock ticks in the
+ * future.
+ *
+ * Pending timeouts are kept in a hierarchical timer wheel, which is
+ * run from timerclock() whenever the timer device reaches the next
+ * tick that has something due. Adding and cancelling a timeout are
+ * O(1); a timeout more than 256 ticks out is cascaded down to a finer
+ * level at most three times before it fires.
+ *
+ * The function is called from the timer interrupt handler with no
+ * locks held, so it must not sleep. It may call wchan_wakeone
+ * and friends, and it may re-add its own timeout.
+ *
+ * The caller owns the storage for a struct timeout and must not free
+ * it while it's pending; timeout_del() guarantees the function is no
+ * longer running when it returns, so a timeout on the stack is safe
+ * as long as it's deleted before the function returns.
+ */
+
+struct timeout {
+	struct timeout *to_next;	/* next on wheel slot */
+	struct timeout **to_prevp;	/* link to us; NULL if not pending */
+	uint32_t to_expire;		/* tick at which to fire */
+	void (*to_func)(void *);	/* function to call */
+	void *to_arg;			/* argument to pass it */
+};
+
+/* Initialize a timeout to call FUNC(ARG). */
+void timeout_init(struct timeout *to, void (*func)(void *), void *arg);
+
+/*
+ * Arrange for TO to fire TICKS hardclocks from now. If it's already
+ * pending it is rescheduled. TICKS of 0 fires on the next tick.
+ */
+void timeout_add(struct timeout *to, unsigned ticks);
+
+/*
+ * Cancel TO. Returns true if it was pending (and so will now not
+ * fire), false if it had already fired or was never added. Waits for
+ * the function to finish if it's running on another cpu.
+ */
+bool timeout_del(struct timeout *to);
+
+/* Return true if TO is waiting to fire. */
+bool timeout_pending(struct timeout *to);
+
+/*
+ * Current time in hardclock ticks, as used by the wheel. Only
+ * differences between values are meaningful.
+ */
+uint32_t timeout_ticks(void);
+
+/* Setup, called from hardclock_bootstrap. */
+void timeout_bootstrap(void);
+
+/* Run everything that's due and rearm the timer; from timerclock. */
+void timeout_run(void);
+
+
+#endif /* _TIMEOUT_H_ */
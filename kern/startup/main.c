@@ -48,6 +48,8 @@
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
+#include <lockstat.h>
+#include <futex.h>
 #include "autoconf.h"  // for pseudoconfig
 
 /*
@@ -113,6 +115,7 @@ boot(void)
 	thread_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+	futex_bootstrap();
 
 
 
@@ -121,6 +124,10 @@ boot(void)
 	KASSERT(curthread->t_curspl > 0);
 	mainbus_bootstrap();
 	KASSERT(curthread->t_curspl == 0);
+#if OPT_LOCKSTAT
+	/* The clock is attached now. */
+	lockstat_bootstrap();
+#endif
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
@@ -40,6 +40,8 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
+#include <syscallstat.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -416,6 +418,108 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_ps(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	proc_printps();
+
+	return 0;
+}
+
+static
+int
+cmd_top(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printcpustats();
+	kprintf("\n");
+	proc_printps();
+
+	return 0;
+}
+
+static
+int
+cmd_schedstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printschedstats();
+
+	return 0;
+}
+
+static
+int
+cmd_poolstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printpoolstats();
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	lockstat_print();
+
+	return 0;
+}
+
+static
+int
+cmd_lockstatreset(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	lockstat_reset();
+
+	return 0;
+}
+#endif
+
+#if OPT_SYSCALLSTAT
+static
+int
+cmd_syscallstat(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	syscallstat_print();
+
+	return 0;
+}
+
+static
+int
+cmd_syscallstatreset(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	syscallstat_reset();
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -486,6 +590,7 @@ static const char *testmenu[] = {
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
 	"[sy5] CV test 2             (1)     ",
+	"[sy4] RW lock test          (1)     ",
 	"[sp1] Whalematching Driver  (1)     ",
 	"[sp2] Stoplight Driver      (1)     ",
 	"[fs1] Filesystem test               ",
@@ -517,6 +622,18 @@ static const char *mainmenu[] = {
 	"[?o] Operations menu                ",
 	"[?t] Tests menu                     ",
 	"[kh] Kernel heap stats              ",
+	"[ss] Scheduler placement stats      ",
+	"[ps] Process list with CPU times    ",
+	"[top] CPU load and process list     ",
+	"[tp] Thread pool stats              ",
+#if OPT_LOCKSTAT
+	"[ls] Lock contention stats          ",
+	"[lsr] Reset lock contention stats   ",
+#endif
+#if OPT_SYSCALLSTAT
+	"[scs] System call stats             ",
+	"[scsr] Reset system call stats      ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -565,6 +682,18 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "ss",         cmd_schedstats },
+	{ "ps",         cmd_ps },
+	{ "top",        cmd_top },
+	{ "tp",         cmd_poolstats },
+#if OPT_LOCKSTAT
+	{ "ls",         cmd_lockstat },
+	{ "lsr",        cmd_lockstatreset },
+#endif
+#if OPT_SYSCALLSTAT
+	{ "scs",        cmd_syscallstat },
+	{ "scsr",       cmd_syscallstatreset },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -583,6 +712,7 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy5",	cvtest2 },
+	{ "sy4",	rwtest },
 	
 #if OPT_SYNCHPROBS
   /* synchronization problem tests */
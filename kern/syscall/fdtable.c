@@ -0,0 +1,418 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <limits.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <vfs.h>
+#include <fdtable.h>
+
+/*
+ * Open files and fd tables; see fdtable.h.
+ */
+
+/* Initial size of an fd table */
+#define FDTABLE_MINSIZE	16
+
+#define FDT_BITS	32
+#define FDT_WORDS(n)	DIVROUNDUP(n, FDT_BITS)
+
+////////////////////////////////////////////////////////////
+// Open files
+
+struct openfile *
+openfile_create(struct vnode *vn, int flags)
+{
+	struct openfile *of;
+
+	of = kmalloc(sizeof(*of));
+	if (of == NULL) {
+		return NULL;
+	}
+	of->of_lock = lock_create("openfile");
+	if (of->of_lock == NULL) {
+		kfree(of);
+		return NULL;
+	}
+	of->of_vnode = vn;
+	of->of_accmode = flags & O_ACCMODE;
+	of->of_append = (flags & O_APPEND) != 0;
+	of->of_offset = 0;
+	spinlock_init(&of->of_reflock);
+	spinlock_setname(&of->of_reflock, "openfile");
+	of->of_refcount = 1;
+	return of;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	spinlock_acquire(&of->of_reflock);
+	KASSERT(of->of_refcount > 0);
+	of->of_refcount++;
+	spinlock_release(&of->of_reflock);
+}
+
+void
+openfile_decref(struct openfile *of)
+{
+	bool last;
+
+	spinlock_acquire(&of->of_reflock);
+	KASSERT(of->of_refcount > 0);
+	of->of_refcount--;
+	last = (of->of_refcount == 0);
+	spinlock_release(&of->of_reflock);
+
+	if (last) {
+		vfs_close(of->of_vnode);
+		lock_destroy(of->of_lock);
+		spinlock_cleanup(&of->of_reflock);
+		kfree(of);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Fd tables
+
+static
+bool
+fdt_isset(struct fdtable *fdt, unsigned fd)
+{
+	return (fdt->fdt_inuse[fd / FDT_BITS] & (1U << (fd % FDT_BITS))) != 0;
+}
+
+/*
+ * Put OF at FD, which must be free. Must hold fdt_lock.
+ */
+static
+void
+fdt_set(struct fdtable *fdt, unsigned fd, struct openfile *of)
+{
+	KASSERT(!fdt_isset(fdt, fd));
+	fdt->fdt_inuse[fd / FDT_BITS] |= 1U << (fd % FDT_BITS);
+	fdt->fdt_files[fd] = of;
+	if (fd == fdt->fdt_lowfree) {
+		fdt->fdt_lowfree++;
+	}
+}
+
+/*
+ * Empty FD and return what was there. Must hold fdt_lock.
+ */
+static
+struct openfile *
+fdt_clear(struct fdtable *fdt, unsigned fd)
+{
+	struct openfile *of;
+
+	KASSERT(fdt_isset(fdt, fd));
+	fdt->fdt_inuse[fd / FDT_BITS] &= ~(1U << (fd % FDT_BITS));
+	of = fdt->fdt_files[fd];
+	fdt->fdt_files[fd] = NULL;
+	if (fd < fdt->fdt_lowfree) {
+		fdt->fdt_lowfree = fd;
+	}
+	return of;
+}
+
+/*
+ * Find the lowest free fd, or -1 if the table is full at its present
+ * size. Must hold fdt_lock.
+ */
+static
+int
+fdt_findfree(struct fdtable *fdt)
+{
+	unsigned w, b, fd;
+	uint32_t word;
+
+	for (w = fdt->fdt_lowfree / FDT_BITS; w < FDT_WORDS(fdt->fdt_size); w++) {
+		word = fdt->fdt_inuse[w];
+		if (word == 0xffffffff) {
+			continue;
+		}
+		for (b = 0; word & (1U << b); b++) {
+			/* nothing */
+		}
+		fd = w * FDT_BITS + b;
+		if (fd >= fdt->fdt_size) {
+			break;
+		}
+		fdt->fdt_lowfree = fd;
+		return fd;
+	}
+	fdt->fdt_lowfree = fdt->fdt_size;
+	return -1;
+}
+
+/*
+ * Make room for at least MINSIZE fds. Don't hold fdt_lock; the new
+ * arrays are allocated without it and swapped in with it.
+ */
+static
+int
+fdtable_grow(struct fdtable *fdt, unsigned minsize)
+{
+	struct openfile **files, **oldfiles;
+	uint32_t *inuse, *oldinuse;
+	unsigned size, i;
+
+	KASSERT(minsize <= OPEN_MAX);
+
+	spinlock_acquire(&fdt->fdt_lock);
+	size = fdt->fdt_size;
+	spinlock_release(&fdt->fdt_lock);
+	if (size >= minsize) {
+		return 0;
+	}
+	while (size < minsize) {
+		size *= 2;
+	}
+	if (size > OPEN_MAX) {
+		size = OPEN_MAX;
+	}
+
+	files = kmalloc(size * sizeof(*files));
+	if (files == NULL) {
+		return ENOMEM;
+	}
+	inuse = kmalloc(FDT_WORDS(size) * sizeof(*inuse));
+	if (inuse == NULL) {
+		kfree(files);
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&fdt->fdt_lock);
+	if (fdt->fdt_size >= size) {
+		/* Another thread beat us to it */
+		spinlock_release(&fdt->fdt_lock);
+		kfree(files);
+		kfree(inuse);
+		return 0;
+	}
+	for (i=0; i<size; i++) {
+		files[i] = i < fdt->fdt_size ? fdt->fdt_files[i] : NULL;
+	}
+	for (i=0; i<FDT_WORDS(size); i++) {
+		inuse[i] = i < FDT_WORDS(fdt->fdt_size) ? fdt->fdt_inuse[i] : 0;
+	}
+	oldfiles = fdt->fdt_files;
+	oldinuse = fdt->fdt_inuse;
+	fdt->fdt_files = files;
+	fdt->fdt_inuse = inuse;
+	fdt->fdt_size = size;
+	spinlock_release(&fdt->fdt_lock);
+
+	kfree(oldfiles);
+	kfree(oldinuse);
+	return 0;
+}
+
+struct fdtable *
+fdtable_create(void)
+{
+	struct fdtable *fdt;
+	unsigned i;
+
+	fdt = kmalloc(sizeof(*fdt));
+	if (fdt == NULL) {
+		return NULL;
+	}
+	fdt->fdt_files = kmalloc(FDTABLE_MINSIZE * sizeof(*fdt->fdt_files));
+	if (fdt->fdt_files == NULL) {
+		kfree(fdt);
+		return NULL;
+	}
+	fdt->fdt_inuse = kmalloc(FDT_WORDS(FDTABLE_MINSIZE) *
+				 sizeof(*fdt->fdt_inuse));
+	if (fdt->fdt_inuse == NULL) {
+		kfree(fdt->fdt_files);
+		kfree(fdt);
+		return NULL;
+	}
+	for (i=0; i<FDTABLE_MINSIZE; i++) {
+		fdt->fdt_files[i] = NULL;
+	}
+	for (i=0; i<FDT_WORDS(FDTABLE_MINSIZE); i++) {
+		fdt->fdt_inuse[i] = 0;
+	}
+	spinlock_init(&fdt->fdt_lock);
+	spinlock_setname(&fdt->fdt_lock, "fdtable");
+	fdt->fdt_size = FDTABLE_MINSIZE;
+	fdt->fdt_lowfree = 0;
+	return fdt;
+}
+
+void
+fdtable_destroy(struct fdtable *fdt)
+{
+	unsigned fd;
+
+	for (fd=0; fd<fdt->fdt_size; fd++) {
+		if (fdt_isset(fdt, fd)) {
+			openfile_decref(fdt_clear(fdt, fd));
+		}
+	}
+	spinlock_cleanup(&fdt->fdt_lock);
+	kfree(fdt->fdt_files);
+	kfree(fdt->fdt_inuse);
+	kfree(fdt);
+}
+
+int
+fdtable_copy(struct fdtable *src, struct fdtable *dst)
+{
+	unsigned fd, size;
+	int result;
+
+	KASSERT(dst->fdt_lowfree == 0);
+
+	while (1) {
+		spinlock_acquire(&src->fdt_lock);
+		size = src->fdt_size;
+		spinlock_release(&src->fdt_lock);
+
+		result = fdtable_grow(dst, size);
+		if (result) {
+			return result;
+		}
+
+		spinlock_acquire(&src->fdt_lock);
+		if (src->fdt_size <= dst->fdt_size) {
+			break;
+		}
+		/* It grew meanwhile; go round again */
+		spinlock_release(&src->fdt_lock);
+	}
+
+	/* Nobody else can see DST yet, so it needs no locking. */
+	for (fd=0; fd<src->fdt_size; fd++) {
+		if (fdt_isset(src, fd)) {
+			openfile_incref(src->fdt_files[fd]);
+			fdt_set(dst, fd, src->fdt_files[fd]);
+		}
+	}
+	dst->fdt_lowfree = src->fdt_lowfree;
+	spinlock_release(&src->fdt_lock);
+
+	return 0;
+}
+
+int
+fdtable_alloc(struct fdtable *fdt, struct openfile *of, int *fd)
+{
+	unsigned size;
+	int newfd, result;
+
+	while (1) {
+		spinlock_acquire(&fdt->fdt_lock);
+		newfd = fdt_findfree(fdt);
+		if (newfd >= 0) {
+			fdt_set(fdt, newfd, of);
+			spinlock_release(&fdt->fdt_lock);
+			*fd = newfd;
+			return 0;
+		}
+		size = fdt->fdt_size;
+		spinlock_release(&fdt->fdt_lock);
+
+		if (size >= OPEN_MAX) {
+			return EMFILE;
+		}
+		result = fdtable_grow(fdt, size + 1);
+		if (result) {
+			return result;
+		}
+	}
+}
+
+int
+fdtable_get(struct fdtable *fdt, int fd, struct openfile **ret)
+{
+	struct openfile *of;
+
+	spinlock_acquire(&fdt->fdt_lock);
+	if (fd < 0 || (unsigned)fd >= fdt->fdt_size || !fdt_isset(fdt, fd)) {
+		spinlock_release(&fdt->fdt_lock);
+		return EBADF;
+	}
+	of = fdt->fdt_files[fd];
+	openfile_incref(of);
+	spinlock_release(&fdt->fdt_lock);
+
+	*ret = of;
+	return 0;
+}
+
+int
+fdtable_remove(struct fdtable *fdt, int fd, struct openfile **ret)
+{
+	spinlock_acquire(&fdt->fdt_lock);
+	if (fd < 0 || (unsigned)fd >= fdt->fdt_size || !fdt_isset(fdt, fd)) {
+		spinlock_release(&fdt->fdt_lock);
+		return EBADF;
+	}
+	*ret = fdt_clear(fdt, fd);
+	spinlock_release(&fdt->fdt_lock);
+	return 0;
+}
+
+int
+fdtable_install(struct fdtable *fdt, int fd, struct openfile *of,
+		struct openfile **oldof)
+{
+	int result;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+	result = fdtable_grow(fdt, fd + 1);
+	if (result) {
+		return result;
+	}
+
+	spinlock_acquire(&fdt->fdt_lock);
+	*oldof = NULL;
+	if (fdt_isset(fdt, fd)) {
+		*oldof = fdt_clear(fdt, fd);
+	}
+	fdt_set(fdt, fd, of);
+	spinlock_release(&fdt->fdt_lock);
+	return 0;
+}
+
+int
+fdtable_dup2(struct fdtable *fdt, int oldfd, int newfd,
+	     struct openfile **oldof)
+{
+	struct openfile *of;
+	int result;
+
+	if (newfd < 0 || newfd >= OPEN_MAX) {
+		return EBADF;
+	}
+	result = fdtable_grow(fdt, newfd + 1);
+	if (result) {
+		return result;
+	}
+
+	spinlock_acquire(&fdt->fdt_lock);
+	if (oldfd < 0 || (unsigned)oldfd >= fdt->fdt_size ||
+	    !fdt_isset(fdt, oldfd)) {
+		spinlock_release(&fdt->fdt_lock);
+		return EBADF;
+	}
+	*oldof = NULL;
+	if (oldfd != newfd) {
+		of = fdt->fdt_files[oldfd];
+		if (fdt_isset(fdt, newfd)) {
+			*oldof = fdt_clear(fdt, newfd);
+		}
+		openfile_incref(of);
+		fdt_set(fdt, newfd, of);
+	}
+	spinlock_release(&fdt->fdt_lock);
+	return 0;
+}
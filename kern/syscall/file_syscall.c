@@ -11,6 +11,7 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <file_syscall.h>
+#include <fdtable.h>
 #include <current.h>
 #include <lib.h>
 #include <synch.h>
@@ -21,363 +22,399 @@
 #include <stat.h>
 #include <kern/unistd.h>
 #include <kern/seek.h>
+#include <vm.h>
+#include <pipe.h>
 
 
-struct file_descriptor*
-file_descriptor_init(char *name)
+/*
+ * Open the console as fds 0, 1 and 2 of the empty table FDT.
+ */
+int
+intialize_file_desc_tbl(struct fdtable *fdt)
 {
-	struct file_descriptor *fd;
-
-		fd = kmalloc(sizeof(struct file_descriptor));
-		if(fd==NULL){
-			return NULL;
+	static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	char con_name[5];
+	struct vnode *v;
+	struct openfile *of;
+	int i, fd, result;
+
+	for (i=0; i<3; i++) {
+		/* vfs_open may scribble on the name */
+		strcpy(con_name, "con:");
+		result = vfs_open(con_name, modes[i], 0664, &v);
+		if (result) {
+			return result;
 		}
-
-		fd->f_name=kstrdup(name);
-		if(fd->f_name==NULL){
-			kfree(fd);
-			return NULL;
+		of = openfile_create(v, modes[i]);
+		if (of == NULL) {
+			vfs_close(v);
+			return ENOMEM;
 		}
-
-		fd->f_lock=lock_create(fd->f_name);
-		   	if (fd->f_lock == NULL) {
-		   		kfree(fd->f_lock);
-		   		kfree(fd);
-			    return NULL;
+		result = fdtable_alloc(fdt, of, &fd);
+		if (result) {
+			openfile_decref(of);
+			return result;
 		}
-
-	return fd;
-
-}
-void
-file_descriptor_cleanup(struct file_descriptor *fd)
-{
-	KASSERT(fd != NULL);
-	lock_destroy(fd->f_lock);
-	kfree(fd->f_name);
-	kfree(fd);
+		KASSERT(fd == i);
+	}
+	return 0;
 }
 
 int
-intialize_file_desc_tbl(struct file_descriptor *file_table[]){
-
+sys_open(userptr_t filename, int flags, int *return_val)
+{
+	char path[PATH_MAX];
+	struct vnode *vn;
+	struct openfile *of;
+	int fd, result;
 
-	char filename[5]= "con:";
+	if ((flags & O_ACCMODE) == O_ACCMODE) {
+		return EINVAL;
+	}
 
-	int result;
-	char con_name_in[5];
-	strcpy(con_name_in, filename);
-	struct vnode *v;
-	result= vfs_open(con_name_in, STDIN_FILENO ,0664, &v);
-	if(result){
+	result = copyinstr((const_userptr_t)filename, path, sizeof(path), NULL);
+	if (result) {
 		return result;
 	}
-	struct file_descriptor* fd_in;
-	fd_in = intialize_file_desc_con(v, 0, filename, STDIN_FILENO);
-	file_table[0]=fd_in;
-	vfs_close(v);
 
-
-	char con_name_out[5];
-	strcpy(con_name_out, filename);
-	result= vfs_open(con_name_out, STDOUT_FILENO ,0664, &v);
-	if(result){
+	result = vfs_open(path, flags, 0664, &vn);
+	if (result) {
 		return result;
 	}
-	struct file_descriptor* fd_out;
-	fd_out = intialize_file_desc_con(v, 0, filename, STDOUT_FILENO);
-	file_table[1]=fd_out;
-	vfs_close(v);
 
-	char con_name_err[5];
-	strcpy(con_name_err, filename);
-	result= vfs_open(con_name_err, STDERR_FILENO ,0664, &v);
-	if(result){
-		return result;
+	of = openfile_create(vn, flags);
+	if (of == NULL) {
+		vfs_close(vn);
+		return ENOMEM;
 	}
-	struct file_descriptor* fd_err;
-	fd_err = intialize_file_desc_con(v, 0, filename, STDERR_FILENO);
-	file_table[2]=fd_err;
-	vfs_close(v);
 
-	for(int i=3; i<__OPEN_MAX;i++){
-		file_table[i]=0;
+	result = fdtable_alloc(curthread->file_table, of, &fd);
+	if (result) {
+		openfile_decref(of);
+		return result;
 	}
-return 0;
 
-}
-struct file_descriptor*
-intialize_file_desc_con(struct vnode *v, int index, char *file_name, int open_type){
-	struct file_descriptor *fd;
-	fd= file_descriptor_init(file_name);
-	lock_acquire(fd->f_lock);
-	fd->f_flag= open_type;		//fd.f_name= k_des;
-	fd->f_object= v;
-	fd->f_offset=0;
-	fd->reference_count=1;
-	curthread->file_table[index]=fd;
-	lock_release(fd->f_lock);
-return fd;
+	*return_val = fd;
+	return 0;
 }
 
 int
-sys_open(userptr_t filename, int flags, int *return_val)   /*Done using copyinstr as said in blog*/
+sys_close(int fd)
 {
-	struct file_descriptor *fd;
-	struct vnode *vn;
+	struct openfile *of;
 	int result;
-	struct stat st;
-	/*void des;
-	size_t length;
-	if((result=copyin((const_userptr_t)filename, &des, length ))!= 0){
-			return result;
-	}*/
-	char k_des[NAME_MAX];
-	size_t actual_length;
-	if((result=copyinstr((const_userptr_t)filename, k_des, NAME_MAX, &actual_length ))!= 0){
+
+	result = fdtable_remove(curthread->file_table, fd, &of);
+	if (result) {
 		return result;
 	}
-	char *file_name= k_des;
-		for(int i=3; i<__OPEN_MAX;i++){
-			if(curthread->file_table[i]==  0){
-				if((flags&O_ACCMODE)== O_RDONLY){
-					result= vfs_open(k_des, flags, 0, &vn);
-				}
-				else if((flags&O_ACCMODE)== O_WRONLY){
-					result= vfs_open(k_des, flags, 0, &vn);
-				}
-				else if((flags&O_ACCMODE)== O_RDWR){
-					result= vfs_open(k_des, flags, 0, &vn);
-				}
-				else if((flags&O_APPEND)== O_APPEND){
-					result= vfs_open(k_des, flags, 0, &vn);
-					if(result){
-						return result;
-					}
-					result= VOP_STAT(vn, &st);
-					if(result){
-						return result;
-					}
-				}
-				else{
-					return EINVAL;
-				}
-				if(result){
-					return result;
-				}
-				fd= file_descriptor_init(file_name);
-				lock_acquire(fd->f_lock);
-				if((flags& O_APPEND)== O_APPEND){
-					fd->f_flag= O_APPEND;
-				}
-				else{
-					fd->f_flag= (flags&O_ACCMODE);
-				}
-
-				//fd.f_name= k_des;
-				fd->f_object= vn;
-					fd->f_offset=0;
-				//}
-				fd->reference_count=1;
-				*return_val= i;
-				curthread->file_table[i]=fd;
-				lock_release(fd->f_lock);
-
-				break;
-			}
-		}
-return 0;
+	openfile_decref(of);
+	return 0;
 }
 
+/*
+ * Make a pipe and put the fds of its read and write ends in the two
+ * ints at FDS.
+ */
 int
-sys_close(int fd){						/*I have done KFREE not sure, whether we have to use this or not, Just confirm once again*/
+sys_pipe(userptr_t fds)
+{
+	struct fdtable *fdt = curthread->file_table;
+	struct vnode *rvn, *wvn;
+	struct openfile *rof, *wof, *of;
+	int kfds[2];
+	int result;
 
-  	if(fd <0 || fd>=__OPEN_MAX){
-			return EBADF;
+	result = pipe_create(PIPE_BUFSIZE, &rvn, &wvn);
+	if (result) {
+		return result;
 	}
-	struct file_descriptor *fd_frm_table;
-	struct vnode *vn;
-	fd_frm_table= curthread->file_table[fd];
-	if(fd_frm_table ==0 ){
-		return EBADF;
+
+	rof = openfile_create(rvn, O_RDONLY);
+	if (rof == NULL) {
+		vfs_close(rvn);
+		vfs_close(wvn);
+		return ENOMEM;
+	}
+	wof = openfile_create(wvn, O_WRONLY);
+	if (wof == NULL) {
+		openfile_decref(rof);
+		vfs_close(wvn);
+		return ENOMEM;
+	}
+
+	result = fdtable_alloc(fdt, rof, &kfds[0]);
+	if (result) {
+		openfile_decref(rof);
+		openfile_decref(wof);
+		return result;
+	}
+	result = fdtable_alloc(fdt, wof, &kfds[1]);
+	if (result) {
+		openfile_decref(wof);
+		goto fail;
+	}
+
+	result = copyout(kfds, fds, sizeof(kfds));
+	if (result) {
+		if (fdtable_remove(fdt, kfds[1], &of) == 0) {
+			openfile_decref(of);
+		}
+		goto fail;
 	}
-	lock_acquire(fd_frm_table->f_lock);
-	fd_frm_table->reference_count--;
-	if(fd_frm_table->reference_count == 0){
-		vn= fd_frm_table->f_object;
-		vfs_close(vn);
-		lock_release(fd_frm_table->f_lock);
-		file_descriptor_cleanup(fd_frm_table);
-		//&return_value= 0;
-		curthread->file_table[fd]=0;
-		return 0;
-	}
-	lock_release(fd_frm_table->f_lock);
-	//&return_value=0;
 	return 0;
+
+ fail:
+	if (fdtable_remove(fdt, kfds[0], &of) == 0) {
+		openfile_decref(of);
+	}
+	return result;
 }
 
-/*Dont know how to check whether buf is valid address space or not
- *Need to do that
- *
- *
- *Getting the corresponding file_descriptor object from the table and using to read the data from the file
- *It means that file need to be open before read
- *
- *Saw the code mainly from loadelf.c and rest read the blog and implemented
+/*
+ * Check that a user buffer lies entirely within user space. The I/O
+ * itself goes straight between the file and the user's pages, and
+ * still fails with EFAULT if a page in the range isn't mapped.
  */
-
+static
 int
-sys_read(int fd, userptr_t buf, size_t buflen, int *return_value){
-
-
+check_userbuf(userptr_t buf, size_t len)
+{
+	vaddr_t start = (vaddr_t)buf;
 
+	if (buf == NULL || start + len < start || start + len > USERSPACETOP) {
+		return EFAULT;
+	}
+	return 0;
+}
 
+/*
+ * Do the read or write described by the user-space uio U. Its
+ * buffers are checked here, and its residual count is set from them.
+ * If POSITIONAL, the I/O is done at U's offset and the file's offset
+ * is neither used nor locked; otherwise it is done at the file's
+ * offset, which is advanced by what was transferred, and appending
+ * writes go at the end of the file.
+ */
+static
+int
+file_io(int fd, struct uio *u, bool positional, int *retval)
+{
+	struct openfile *of;
+	struct iovec *iov = u->uio_iov;
+	unsigned iovcnt = u->uio_iovcnt;
+	enum uio_rw rw = u->uio_rw;
+	struct stat st;
+	size_t total;
+	unsigned i;
 	int result;
-	void* kbuf = kmalloc(buflen);
-	if ((result = copyin((const_userptr_t)buf, kbuf, buflen)) != 0){
-		kfree(kbuf);
+
+	result = fdtable_get(curthread->file_table, fd, &of);
+	if (result) {
 		return result;
 	}
 
-	if(fd <0 || fd>=__OPEN_MAX){
+	if (of->of_accmode == (rw == UIO_READ ? O_WRONLY : O_RDONLY)) {
+		openfile_decref(of);
 		return EBADF;
 	}
-	struct file_descriptor *fd_frm_table;
-	struct vnode *vn;
-	struct iovec u_iovec;
-	struct uio u_uio;
-	fd_frm_table= curthread->file_table[fd];
-
-	if(fd_frm_table !=0 ){
-		lock_acquire(fd_frm_table->f_lock);
-		vn= fd_frm_table->f_object;
-
-		u_iovec.iov_ubase= buf;
-		u_iovec.iov_len= buflen;
-		u_uio.uio_iov= &u_iovec;
-		u_uio.uio_iovcnt= 1;
-		u_uio.uio_offset= fd_frm_table->f_offset;
-		u_uio.uio_resid= buflen;
-		u_uio.uio_segflg= UIO_USERSPACE;
-		u_uio.uio_rw= UIO_READ;
-		u_uio.uio_space= curthread->t_addrspace;
-
-		result= VOP_READ(vn, &u_uio);
-		if(result){
-			lock_release(fd_frm_table->f_lock);
+
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > USERSPACETOP - total) {
+			openfile_decref(of);
+			return EINVAL;
+		}
+		total += iov[i].iov_len;
+		if (iov[i].iov_len > 0 || iovcnt == 1) {
+			result = check_userbuf(iov[i].iov_ubase, iov[i].iov_len);
+			if (result) {
+				openfile_decref(of);
+				return result;
+			}
+		}
+	}
+
+	u->uio_resid = total;
+
+	if (positional) {
+		/* Also fails with ESPIPE on things that can't seek */
+		result = VOP_TRYSEEK(of->of_vnode, u->uio_offset);
+		if (result) {
+			openfile_decref(of);
 			return result;
 		}
-		else{
-			*return_value= (buflen-u_uio.uio_resid); /*Need to return the length left to read, I think*/
-			fd_frm_table->f_offset+= buflen-u_uio.uio_resid;
-			lock_release(fd_frm_table->f_lock);
+	}
+	else {
+		lock_acquire(of->of_lock);
+		if (rw == UIO_WRITE && of->of_append) {
+			result = VOP_STAT(of->of_vnode, &st);
+			if (result) {
+				lock_release(of->of_lock);
+				openfile_decref(of);
+				return result;
+			}
+			of->of_offset = st.st_size;
 		}
+		u->uio_offset = of->of_offset;
 	}
-	else{
-		return EBADF;
+
+	/* Transfer straight to or from the user's buffers */
+	if (rw == UIO_READ) {
+		result = VOP_READ(of->of_vnode, u);
+	}
+	else {
+		result = VOP_WRITE(of->of_vnode, u);
+	}
+	if (result == 0) {
+		*retval = total - u->uio_resid;
 	}
 
+	if (!positional) {
+		if (result == 0) {
+			of->of_offset = u->uio_offset;
+		}
+		lock_release(of->of_lock);
+	}
 
-return 0;
+	openfile_decref(of);
+	return result;
 }
+
 /*
- * There are some error codes that need to be returned but dont know whether to check them or not
+ * Copy in a user iovec array of IOVCNT entries. Small arrays go in
+ * SMALL; larger ones are kmalloc'd, and *IOVP must then be freed.
  */
+#define SMALL_IOVCNT	8
+
+static
 int
-sys_write(int fd, userptr_t buf, size_t nbytes, int *return_value){
+copyin_iovec(const_userptr_t uiov, int iovcnt, struct iovec *small,
+	     struct iovec **iovp)
+{
+	struct iovec *iov;
+	int result;
 
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+	if (iovcnt <= SMALL_IOVCNT) {
+		iov = small;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result) {
+		if (iov != small) {
+			kfree(iov);
+		}
+		return result;
+	}
+	*iovp = iov;
+	return 0;
+}
 
+static
+int
+file_iov(int fd, const_userptr_t uiov, int iovcnt, bool positional,
+	 off_t pos, enum uio_rw rw, int *retval)
+{
+	struct iovec small[SMALL_IOVCNT], *iov;
+	struct uio u;
 	int result;
-	void* kbuf = kmalloc(nbytes);
-	if ((result = copyin((const_userptr_t)buf, kbuf, nbytes)) != 0){
-		kfree(kbuf);
+
+	result = copyin_iovec(uiov, iovcnt, small, &iov);
+	if (result) {
 		return result;
 	}
-	if(fd <0 || fd>=__OPEN_MAX){
-			return EBADF;
+
+	/* Like uio_uinit, but over the whole array; file_io sets the size */
+	u.uio_iov = iov;
+	u.uio_iovcnt = iovcnt;
+	u.uio_offset = pos;
+	u.uio_resid = 0;
+	u.uio_segflg = UIO_USERSPACE;
+	u.uio_rw = rw;
+	u.uio_space = curthread->t_addrspace;
+
+	result = file_io(fd, &u, positional, retval);
+	if (iov != small) {
+		kfree(iov);
 	}
-	struct file_descriptor *fd_frm_table;
-	struct vnode *vn;
-	struct iovec u_iovec;
-	struct uio u_uio;
-	fd_frm_table= curthread->file_table[fd];
-	if(fd_frm_table != 0){
-		lock_acquire(fd_frm_table->f_lock);
-		if(!(fd_frm_table->f_flag == O_RDWR || fd_frm_table->f_flag == O_WRONLY)){
-			lock_release(fd_frm_table->f_lock);
-			return EROFS;
-		}
+	return result;
+}
 
-		u_uio.uio_offset= fd_frm_table->f_offset;
-		vn= fd_frm_table->f_object;
-		u_iovec.iov_ubase= buf;
-		u_iovec.iov_len= nbytes;
+int
+sys_read(int fd, userptr_t buf, size_t buflen, int *return_value)
+{
+	struct iovec iov;
+	struct uio u;
 
-		u_uio.uio_iov= &u_iovec;
-		u_uio.uio_iovcnt= 1;
+	uio_uinit(&iov, &u, buf, buflen, 0, UIO_READ);
+	return file_io(fd, &u, false, return_value);
+}
 
-		u_uio.uio_resid= nbytes;
-		u_uio.uio_rw= UIO_WRITE;
-		u_uio.uio_segflg= UIO_USERSPACE;
-		u_uio.uio_space= curthread->t_addrspace;
+int
+sys_write(int fd, userptr_t buf, size_t nbytes, int *return_value)
+{
+	struct iovec iov;
+	struct uio u;
 
-		result= VOP_WRITE(vn, &u_uio);
-		if(result){
-			lock_release(fd_frm_table->f_lock);
-			return result;
-		}
-		else{
-			*return_value= (nbytes-u_uio.uio_resid);
-			fd_frm_table->f_offset+= nbytes-u_uio.uio_resid;
-			lock_release(fd_frm_table->f_lock);
-		}
-	}
-	else{
-		return EBADF;
-	}
+	uio_uinit(&iov, &u, buf, nbytes, 0, UIO_WRITE);
+	return file_io(fd, &u, false, return_value);
+}
 
+int
+sys_pread(int fd, userptr_t buf, size_t buflen, off_t pos, int *retval)
+{
+	struct iovec iov;
+	struct uio u;
 
-return 0;
+	uio_uinit(&iov, &u, buf, buflen, pos, UIO_READ);
+	return file_io(fd, &u, true, retval);
 }
 
 int
-dup2(int oldfd, int newfd, int *return_value){
+sys_pwrite(int fd, userptr_t buf, size_t nbytes, off_t pos, int *retval)
+{
+	struct iovec iov;
+	struct uio u;
 
-	if(newfd<=0 || newfd>=__OPEN_MAX || oldfd<0 || oldfd>=__OPEN_MAX){
-		return EBADF;
+	uio_uinit(&iov, &u, buf, nbytes, pos, UIO_WRITE);
+	return file_io(fd, &u, true, retval);
+}
+
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return file_iov(fd, iov, iovcnt, false, 0, UIO_READ, retval);
+}
+
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return file_iov(fd, iov, iovcnt, false, 0, UIO_WRITE, retval);
+}
+
+int
+dup2(int oldfd, int newfd, int *return_value)
+{
+	struct openfile *oldof;
+	int result;
+
+	result = fdtable_dup2(curthread->file_table, oldfd, newfd, &oldof);
+	if (result) {
+		return result;
 	}
-	else{
-		struct file_descriptor *fd;
-		fd= curthread->file_table[oldfd];
-		if(fd==0){
-			return EBADF;
-		}
-		int count=0;
-		for(int i=3; i<__OPEN_MAX;i++){
-			if(curthread->file_table[i]!= 0){
-				count++;
-			}
-			else{
-				break;
-			}
-		}
-		if(count== __OPEN_MAX){
-			return EMFILE;
-		}
-		if(newfd != oldfd){
-			if(curthread->file_table[newfd]!= 0){
-				sys_close(newfd);
-			}
-			curthread->file_table[newfd]= fd;
-			fd->reference_count++;
-			*return_value= newfd;
-		}
-		else{
-			*return_value= oldfd;
-		}
+	if (oldof != NULL) {
+		openfile_decref(oldof);
 	}
-return 0;
+	*return_value = newfd;
+	return 0;
 }
 
 int
@@ -390,16 +427,7 @@ __getcwd(userptr_t buf, size_t buflen, int *return_value){
 	}
 	struct uio u_uio;
 	struct iovec u_iovec;
-	u_iovec.iov_ubase= buf;
-	u_iovec.iov_len= buflen;
-
-	u_uio.uio_iov= &u_iovec;
-	u_uio.uio_iovcnt= 1;
-	u_uio.uio_offset=0;
-	u_uio.uio_resid= buflen;
-	u_uio.uio_rw= UIO_READ;
-	u_uio.uio_segflg= UIO_USERSPACE;
-	u_uio.uio_space= curthread->t_addrspace;
+	uio_uinit(&u_iovec, &u_uio, buf, buflen, 0, UIO_READ);
 
 	result = vfs_getcwd(&u_uio);
 	if (result) {
@@ -426,72 +454,327 @@ chdir(userptr_t pathname){
 return 0;
 }
 
+/*
+ * Move FD's offset as lseek does and return the new one in *NEWPOS.
+ */
 int
-lseek(int fd, off_t pos, int32_t whence, int32_t *return_value1, int32_t *return_value2){
+file_lseek(int fd, off_t pos, int whence, off_t *newpos)
+{
+	struct openfile *of;
+	struct stat st;
+	off_t where;
+	int result;
 
-	if(fd <0 || fd>=__OPEN_MAX){
-		return EBADF;
+	result = fdtable_get(curthread->file_table, fd, &of);
+	if (result) {
+		return result;
 	}
-	struct file_descriptor *fd_frm_table;
-	fd_frm_table= curthread->file_table[fd];
-	if(fd_frm_table == 0){
-			return EBADF;
+
+	lock_acquire(of->of_lock);
+	switch (whence) {
+	    case SEEK_SET:
+		where = pos;
+		break;
+	    case SEEK_CUR:
+		where = of->of_offset + pos;
+		break;
+	    case SEEK_END:
+		result = VOP_STAT(of->of_vnode, &st);
+		if (result) {
+			goto out;
+		}
+		where = st.st_size + pos;
+		break;
+	    default:
+		result = EINVAL;
+		goto out;
 	}
-	//int32_t *sz= &whence;
-	int* kbuf = kmalloc(sizeof(whence));
-	int result;
-	if ((result = copyin((const_userptr_t)whence, kbuf, sizeof(whence))) != 0){
-		kfree(kbuf);
+	if (where < 0) {
+		result = EINVAL;
+		goto out;
+	}
+	result = VOP_TRYSEEK(of->of_vnode, where);
+	if (result) {
+		goto out;
+	}
+	of->of_offset = where;
+	*newpos = where;
+ out:
+	lock_release(of->of_lock);
+	openfile_decref(of);
+	return result;
+}
+
+int
+lseek(int fd, off_t pos, int32_t whence, int32_t *return_value1, int32_t *return_value2)
+{
+	off_t newpos;
+	int kwhence, result;
+
+	/* whence is on the user stack; see syscall() */
+	result = copyin((const_userptr_t)whence, &kwhence, sizeof(kwhence));
+	if (result) {
 		return result;
 	}
-	struct vnode *vn;
+
+	result = file_lseek(fd, pos, kwhence, &newpos);
+	if (result) {
+		return result;
+	}
+
+	*return_value1 = (int32_t)(newpos >> 32);
+	*return_value2 = (int32_t)(newpos & 0xffffffff);
+	return 0;
+}
+
+/*
+ * Size of the kernel buffer copy_file_range moves data through.
+ */
+#define COPY_BUFSIZE	(16*1024)
+
+/*
+ * Copy up to LEN bytes from IN at *INPOS to OUT at *OUTPOS, through
+ * the kernel buffer BUF, advancing both positions. Each write but the
+ * last is sized to end on a block boundary of OUT, so a filesystem
+ * that does partial blocks by read-modify-write (like SFS) only has
+ * to do that at the ends of the range. Returns the count copied in
+ * *COPIED, which is short only at end of file or if a write is. Bytes
+ * read but not written don't count; *INPOS is left before them.
+ */
+static
+int
+file_copy(struct openfile *in, off_t *inpos, struct openfile *out,
+	  off_t *outpos, size_t len, char *buf, size_t *copied)
+{
+	struct iovec iov;
+	struct uio u;
 	struct stat st;
-	lock_acquire(fd_frm_table->f_lock);
-	vn= fd_frm_table->f_object;
-	int c_pos= fd_frm_table->f_offset;
-
-	if((*kbuf&O_ACCMODE)== SEEK_SET){
-		result= VOP_TRYSEEK(vn, pos);
-			if(result){
-				lock_release(fd_frm_table->f_lock);
-				return result;
-			}
-			fd_frm_table->f_offset= pos;
+	size_t blksize, chunk, got, put;
+	int result;
 
+	result = VOP_STAT(out->of_vnode, &st);
+	if (result) {
+		return result;
 	}
-	else if((*kbuf&O_ACCMODE)== SEEK_CUR){
-		result= VOP_TRYSEEK(vn, (pos+c_pos));
-			if(result){
-				lock_release(fd_frm_table->f_lock);
-				return result;
+	blksize = st.st_blksize > 0 ? st.st_blksize : 512;
+
+	*copied = 0;
+	while (len > 0) {
+		chunk = len < COPY_BUFSIZE ? len : COPY_BUFSIZE;
+		if (*outpos % blksize != 0) {
+			/* Just enough to get OUT onto a block boundary */
+			put = blksize - *outpos % blksize;
+			if (chunk > put) {
+				chunk = put;
 			}
-			fd_frm_table->f_offset= pos+c_pos;
-	}
-	else if((*kbuf&O_ACCMODE)== SEEK_END){
+		}
+		else if (chunk > blksize) {
+			chunk -= chunk % blksize;
+		}
 
-		result= VOP_STAT(vn, &st);
-		if(result){
-		lock_release(fd_frm_table->f_lock);
-		return result;
+		uio_kinit(&iov, &u, buf, chunk, *inpos, UIO_READ);
+		result = VOP_READ(in->of_vnode, &u);
+		if (result) {
+			return result;
 		}
-		off_t eof= st.st_size;
-		result= VOP_TRYSEEK(vn, (pos+eof));
-		if(result){
-		lock_release(fd_frm_table->f_lock);
-		return result;
+		got = chunk - u.uio_resid;
+		if (got == 0) {
+			/* EOF */
+			break;
+		}
+
+		uio_kinit(&iov, &u, buf, got, *outpos, UIO_WRITE);
+		result = VOP_WRITE(out->of_vnode, &u);
+		if (result) {
+			return result;
+		}
+		/* IN moves on only past what actually got written */
+		put = got - u.uio_resid;
+		*inpos += put;
+		*outpos += put;
+		*copied += put;
+		len -= put;
+		if (put < got) {
+			break;
 		}
-		fd_frm_table->f_offset= pos+eof;
 	}
-	else{
+	return 0;
+}
+
+/*
+ * copy_file_range: copy LEN bytes from INFD to OUTFD without the data
+ * passing through user space. If INOFF (or OUTOFF) is NULL the file's
+ * offset is used and advanced; otherwise the offset is read from and
+ * written back to *INOFF and the file's offset is left alone.
+ */
+int
+sys_copy_file_range(int infd, userptr_t inoff, int outfd, userptr_t outoff,
+		    size_t len, unsigned flags, int *retval)
+{
+	struct openfile *in, *out;
+	struct lock *first, *second;
+	off_t inpos, outpos;
+	size_t copied;
+	char *buf;
+	int result;
+
+	if (flags != 0) {
 		return EINVAL;
 	}
-	int64_t final_value= fd_frm_table->f_offset;
-	int32_t high = (int32_t)((final_value & 0xFFFFFFFF00000000) >> 32);
-	int32_t low = (int32_t)(final_value & 0xFFFFFFFF);
-	*return_value1= high;
-	*return_value2= low;
-	lock_release(fd_frm_table->f_lock);
 
+	if (inoff != NULL) {
+		result = copyin(inoff, &inpos, sizeof(inpos));
+		if (result) {
+			return result;
+		}
+	}
+	if (outoff != NULL) {
+		result = copyin(outoff, &outpos, sizeof(outpos));
+		if (result) {
+			return result;
+		}
+	}
 
-return 0;
+	result = fdtable_get(curthread->file_table, infd, &in);
+	if (result) {
+		return result;
+	}
+	result = fdtable_get(curthread->file_table, outfd, &out);
+	if (result) {
+		openfile_decref(in);
+		return result;
+	}
+
+	if (in->of_accmode == O_WRONLY || out->of_accmode == O_RDONLY ||
+	    out->of_append) {
+		result = EBADF;
+		goto out_files;
+	}
+	if (in == out) {
+		result = EINVAL;
+		goto out_files;
+	}
+	if ((inoff != NULL && inpos < 0) || (outoff != NULL && outpos < 0)) {
+		result = EINVAL;
+		goto out_files;
+	}
+
+	buf = kmalloc(COPY_BUFSIZE);
+	if (buf == NULL) {
+		result = ENOMEM;
+		goto out_files;
+	}
+
+	/*
+	 * Lock the offsets we use, in address order so that two copies
+	 * going opposite ways can't deadlock.
+	 */
+	first = (inoff == NULL) ? in->of_lock : NULL;
+	second = (outoff == NULL) ? out->of_lock : NULL;
+	if (first != NULL && second != NULL && second < first) {
+		first = out->of_lock;
+		second = in->of_lock;
+	}
+	if (first != NULL) {
+		lock_acquire(first);
+	}
+	if (second != NULL) {
+		lock_acquire(second);
+	}
+
+	if (inoff == NULL) {
+		inpos = in->of_offset;
+	}
+	if (outoff == NULL) {
+		outpos = out->of_offset;
+	}
+
+	result = file_copy(in, &inpos, out, &outpos, len, buf, &copied);
+
+	/*
+	 * Even after an error, what was copied stays copied; like a
+	 * short read or write, report that and drop the error.
+	 */
+	if (result && copied > 0) {
+		result = 0;
+	}
+	if (inoff == NULL) {
+		in->of_offset = inpos;
+	}
+	if (outoff == NULL) {
+		out->of_offset = outpos;
+	}
+
+	if (second != NULL) {
+		lock_release(second);
+	}
+	if (first != NULL) {
+		lock_release(first);
+	}
+	kfree(buf);
+
+	if (result == 0 && inoff != NULL) {
+		result = copyout(&inpos, inoff, sizeof(inpos));
+	}
+	if (result == 0 && outoff != NULL) {
+		result = copyout(&outpos, outoff, sizeof(outpos));
+	}
+	if (result == 0) {
+		*retval = copied;
+	}
+
+ out_files:
+	openfile_decref(out);
+	openfile_decref(in);
+	return result;
+}
+
+/*
+ * getdirentries: read as many directory entries from FD as fit in
+ * BUF, packed as struct dirents, starting where the last call left
+ * off. The file's offset is the filesystem's cookie for where that is;
+ * if BASEP isn't NULL the cookie we started from is stored there.
+ * Returns the number of bytes filled, 0 at the end of the directory.
+ */
+int
+sys_getdirentries(int fd, userptr_t buf, size_t buflen, userptr_t basep,
+		  int *retval)
+{
+	struct openfile *of;
+	struct iovec iov;
+	struct uio u;
+	off_t base;
+	int result;
+
+	result = check_userbuf(buf, buflen);
+	if (result) {
+		return result;
+	}
+
+	result = fdtable_get(curthread->file_table, fd, &of);
+	if (result) {
+		return result;
+	}
+	if (of->of_accmode == O_WRONLY) {
+		openfile_decref(of);
+		return EBADF;
+	}
+
+	lock_acquire(of->of_lock);
+	base = of->of_offset;
+	uio_uinit(&iov, &u, buf, buflen, base, UIO_READ);
+	result = VOP_GETDIRENTRIES(of->of_vnode, &u);
+	if (result == 0) {
+		of->of_offset = u.uio_offset;
+	}
+	lock_release(of->of_lock);
+	openfile_decref(of);
+
+	if (result == 0 && basep != NULL) {
+		result = copyout(&base, basep, sizeof(base));
+	}
+	if (result == 0) {
+		*retval = buflen - u.uio_resid;
+	}
+	return result;
 }
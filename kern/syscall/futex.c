@@ -0,0 +1,264 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <copyinout.h>
+#include <futex.h>
+
+/*
+ * Futex wait queues.
+ *
+ * Each word being waited on has a struct futex, found through a hash
+ * of its address space and address, which lives as long as anyone is
+ * waiting on it. Each bucket's lock covers its chain and everything in
+ * the futexes on it.
+ *
+ * The word can't be read with a spinlock held (copyin may fault), so
+ * a waiter first registers on the futex, then reads the word, then
+ * sleeps only if no futex_wake has come along since it registered.
+ * fx_seq counts the wakes; a wake that comes between the registration
+ * and the sleep makes the waiter return instead of sleeping, so it
+ * can't be lost.
+ */
+
+#define FUTEX_NBUCKETS	64
+
+struct futex {
+	struct futex *fx_next;		/* hash chain */
+	struct addrspace *fx_as;	/* key: address space */
+	vaddr_t fx_addr;		/* key: user address */
+	struct wchan *fx_wchan;		/* where the waiters sleep */
+	unsigned fx_waiters;		/* registered waiters */
+	unsigned fx_sleepers;		/* of those, ones on fx_wchan */
+	unsigned fx_seq;		/* wakes so far */
+};
+
+struct futex_bucket {
+	struct spinlock fb_lock;
+	struct futex *fb_head;
+};
+
+static struct futex_bucket futex_table[FUTEX_NBUCKETS];
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		spinlock_init(&futex_table[i].fb_lock);
+		spinlock_setname(&futex_table[i].fb_lock, "futex");
+		futex_table[i].fb_head = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, vaddr_t addr)
+{
+	uintptr_t h;
+
+	h = ((uintptr_t)as >> 4) ^ (addr >> 2);
+	h ^= h >> 12;
+	return &futex_table[h % FUTEX_NBUCKETS];
+}
+
+/*
+ * Look up a futex. Must hold the bucket lock.
+ */
+static
+struct futex *
+futex_find(struct futex_bucket *fb, struct addrspace *as, vaddr_t addr)
+{
+	struct futex *fx;
+
+	for (fx = fb->fb_head; fx != NULL; fx = fx->fx_next) {
+		if (fx->fx_as == as && fx->fx_addr == addr) {
+			return fx;
+		}
+	}
+	return NULL;
+}
+
+static
+struct futex *
+futex_create(struct addrspace *as, vaddr_t addr)
+{
+	struct futex *fx;
+
+	fx = kmalloc(sizeof(*fx));
+	if (fx == NULL) {
+		return NULL;
+	}
+	fx->fx_wchan = wchan_create("futex");
+	if (fx->fx_wchan == NULL) {
+		kfree(fx);
+		return NULL;
+	}
+	fx->fx_next = NULL;
+	fx->fx_as = as;
+	fx->fx_addr = addr;
+	fx->fx_waiters = 0;
+	fx->fx_sleepers = 0;
+	fx->fx_seq = 0;
+	return fx;
+}
+
+static
+void
+futex_destroy(struct futex *fx)
+{
+	KASSERT(fx->fx_waiters == 0);
+	wchan_destroy(fx->fx_wchan);
+	kfree(fx);
+}
+
+/*
+ * Register as a waiter on the futex for (AS, ADDR), making it if
+ * need be. Returns the futex, and the wake count as of registering in
+ * SEQ, or NULL if out of memory.
+ */
+static
+struct futex *
+futex_register(struct futex_bucket *fb, struct addrspace *as, vaddr_t addr,
+	       unsigned *seq)
+{
+	struct futex *fx, *newfx;
+
+	newfx = NULL;
+	spinlock_acquire(&fb->fb_lock);
+	fx = futex_find(fb, as, addr);
+	if (fx == NULL) {
+		/* Can't kmalloc with the lock held; try again after. */
+		spinlock_release(&fb->fb_lock);
+		newfx = futex_create(as, addr);
+		if (newfx == NULL) {
+			return NULL;
+		}
+		spinlock_acquire(&fb->fb_lock);
+		fx = futex_find(fb, as, addr);
+		if (fx == NULL) {
+			fx = newfx;
+			newfx = NULL;
+			fx->fx_next = fb->fb_head;
+			fb->fb_head = fx;
+		}
+	}
+	fx->fx_waiters++;
+	*seq = fx->fx_seq;
+	spinlock_release(&fb->fb_lock);
+
+	if (newfx != NULL) {
+		/* Somebody else made it meanwhile */
+		futex_destroy(newfx);
+	}
+	return fx;
+}
+
+/*
+ * Stop being a waiter on FX, and throw it away if that was the last
+ * one. Must hold the bucket lock, which is released.
+ */
+static
+void
+futex_unregister(struct futex_bucket *fb, struct futex *fx)
+{
+	struct futex **fxp;
+
+	KASSERT(fx->fx_waiters > 0);
+	fx->fx_waiters--;
+	if (fx->fx_waiters > 0) {
+		spinlock_release(&fb->fb_lock);
+		return;
+	}
+
+	for (fxp = &fb->fb_head; *fxp != fx; fxp = &(*fxp)->fx_next) {
+		KASSERT(*fxp != NULL);
+	}
+	*fxp = fx->fx_next;
+	spinlock_release(&fb->fb_lock);
+
+	futex_destroy(fx);
+}
+
+/*
+ * Sleep until woken by futex_wake on UADDR, as long as *UADDR is VAL.
+ * Returns EAGAIN if it isn't.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int val)
+{
+	struct addrspace *as = curthread->t_addrspace;
+	vaddr_t addr = (vaddr_t)uaddr;
+	struct futex_bucket *fb;
+	struct futex *fx;
+	unsigned seq;
+	int cur, result;
+
+	if (addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	fb = futex_hash(as, addr);
+	fx = futex_register(fb, as, addr, &seq);
+	if (fx == NULL) {
+		return ENOMEM;
+	}
+
+	result = copyin(uaddr, &cur, sizeof(cur));
+	if (result == 0 && cur != val) {
+		result = EAGAIN;
+	}
+
+	spinlock_acquire(&fb->fb_lock);
+	if (result == 0 && fx->fx_seq == seq) {
+		fx->fx_sleepers++;
+		wchan_lock(fx->fx_wchan);
+		spinlock_release(&fb->fb_lock);
+		wchan_sleep(fx->fx_wchan);
+		spinlock_acquire(&fb->fb_lock);
+		/* The waker took us off fx_sleepers */
+	}
+	futex_unregister(fb, fx);
+
+	return result;
+}
+
+/*
+ * Wake up to COUNT threads sleeping in futex_wait on UADDR. Returns
+ * how many were woken.
+ */
+int
+sys_futex_wake(userptr_t uaddr, int count, int32_t *retval)
+{
+	struct addrspace *as = curthread->t_addrspace;
+	vaddr_t addr = (vaddr_t)uaddr;
+	struct futex_bucket *fb;
+	struct futex *fx;
+	int n;
+
+	if (addr % sizeof(int) != 0 || count < 0) {
+		return EINVAL;
+	}
+
+	n = 0;
+	fb = futex_hash(as, addr);
+	spinlock_acquire(&fb->fb_lock);
+	fx = futex_find(fb, as, addr);
+	if (fx != NULL && count > 0) {
+		/* Waiters that haven't gone to sleep yet see this and return */
+		fx->fx_seq++;
+		while (n < count && fx->fx_sleepers > 0) {
+			fx->fx_sleepers--;
+			wchan_wakeone(fx->fx_wchan);
+			n++;
+		}
+	}
+	spinlock_release(&fb->fb_lock);
+
+	*retval = n;
+	return 0;
+}
@@ -13,14 +13,240 @@
 #include <mips/trapframe.h>
 #include <kern/wait.h>
 #include <kern/fcntl.h>
+#include <kern/mman.h>
 #include <vm.h>
 #include <vfs.h>
 #include <syscall.h>
 #include <test.h>
 #include <file_syscall.h>
+#include <fdtable.h>
+#include <cpu.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 
 
 
+/*
+ * The process table.
+ *
+ * A pid picks its slot in the table: slot = pid % PROCESS_MAX. Each
+ * time a slot is freed its pid moves up by PROCESS_MAX (wrapping back
+ * around past PID_MAX), and free slots are reused in FIFO order, so a
+ * pid doesn't come back until its slot has gone round the free list
+ * PID_MAX/PROCESS_MAX times. Allocating, freeing and looking up a pid
+ * are all constant time.
+ *
+ * Slots are allocated PROC_CHUNK at a time as needed, up to
+ * PROCESS_MAX. Chunks never move once allocated, so proc_get doesn't
+ * need pid_lock; allocating and freeing slots do.
+ */
+
+#define PROC_CHUNK	256
+#define PROC_NCHUNKS	((PROCESS_MAX + PROC_CHUNK - 1) / PROC_CHUNK)
+
+struct proc_slot {
+	struct process_control *ps_proc;	/* NULL if not in use */
+	pid_t ps_pid;		/* pid of slot, or its next pid if free */
+	int ps_nextfree;	/* free list link, or -1 */
+};
+
+struct lock *pid_lock;
+static struct proc_slot *proc_chunks[PROC_NCHUNKS];
+static unsigned proc_nslots;
+static int proc_freehead, proc_freetail;
+
+static
+struct proc_slot *
+proc_slot(unsigned slot)
+{
+	return &proc_chunks[slot / PROC_CHUNK][slot % PROC_CHUNK];
+}
+
+/*
+ * Put SLOT on the tail of the free list.
+ */
+static
+void
+proc_freeslot(int slot)
+{
+	proc_slot(slot)->ps_nextfree = -1;
+	if (proc_freetail < 0) {
+		proc_freehead = slot;
+	}
+	else {
+		proc_slot(proc_freetail)->ps_nextfree = slot;
+	}
+	proc_freetail = slot;
+}
+
+/*
+ * Add a chunk of free slots, if there's room. Must hold pid_lock
+ * (unless still booting).
+ */
+static
+void
+proc_grow(void)
+{
+	struct proc_slot *chunk;
+	unsigned i, n, slot;
+
+	if (proc_nslots >= PROCESS_MAX) {
+		return;
+	}
+	n = PROCESS_MAX - proc_nslots;
+	if (n > PROC_CHUNK) {
+		n = PROC_CHUNK;
+	}
+	chunk = kmalloc(PROC_CHUNK * sizeof(*chunk));
+	if (chunk == NULL) {
+		return;
+	}
+	for (i=0; i<n; i++) {
+		slot = proc_nslots + i;
+		chunk[i].ps_proc = NULL;
+		chunk[i].ps_pid = slot;
+		if (chunk[i].ps_pid < PID_MIN) {
+			chunk[i].ps_pid += PROCESS_MAX;
+		}
+	}
+	/* Install the chunk before making its slots visible */
+	proc_chunks[proc_nslots / PROC_CHUNK] = chunk;
+	proc_nslots += n;
+
+	for (i=0; i<n; i++) {
+		proc_freeslot(proc_nslots - n + i);
+	}
+}
+
+/*
+ * Give PID's slot back, moving it on to its next pid. Must hold
+ * pid_lock.
+ */
+static
+void
+proc_free(pid_t pid)
+{
+	struct proc_slot *ps;
+	unsigned slot;
+
+	slot = pid % PROCESS_MAX;
+	ps = proc_slot(slot);
+	KASSERT(ps->ps_pid == pid);
+
+	ps->ps_proc = NULL;
+	if (ps->ps_pid > PID_MAX - PROCESS_MAX) {
+		ps->ps_pid = slot;
+		if (ps->ps_pid < PID_MIN) {
+			ps->ps_pid += PROCESS_MAX;
+		}
+	}
+	else {
+		ps->ps_pid += PROCESS_MAX;
+	}
+	proc_freeslot(slot);
+}
+
+/*
+ * Set up the process table; called from thread_bootstrap before the
+ * first thread is made.
+ */
+void
+proc_bootstrap(void)
+{
+	proc_nslots = 0;
+	proc_freehead = proc_freetail = -1;
+
+	pid_lock = lock_create("pid_lock");
+	if (pid_lock == NULL) {
+		panic("proc_bootstrap: Out of memory\n");
+	}
+}
+
+/*
+ * Look up a process by pid. Returns NULL if there's no such process.
+ */
+struct process_control *
+proc_get(pid_t pid)
+{
+	struct proc_slot *ps;
+	unsigned slot;
+
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+	slot = pid % PROCESS_MAX;
+	if (slot >= proc_nslots) {
+		return NULL;
+	}
+	ps = proc_slot(slot);
+	if (ps->ps_pid != pid) {
+		return NULL;
+	}
+	return ps->ps_proc;
+}
+
+/*
+ * Charge an exited child's CPU usage, and that of any children it
+ * reaped itself, to its parent.
+ */
+static
+void
+proc_reap_usage(struct process_control *parent, struct process_control *child)
+{
+	thread_usage_add(&parent->child_usage, &child->exit_usage);
+	thread_usage_add(&parent->child_usage, &child->child_usage);
+}
+
+/*
+ * Make CHILD a child of PARENT. Processes made without a parent
+ * (kernel threads nobody can wait for) are reaped as soon as they
+ * exit.
+ */
+void
+proc_addchild(pid_t parent, pid_t child)
+{
+	struct process_control *pp, *pc;
+
+	lock_acquire(pid_lock);
+	pp = proc_get(parent);
+	pc = proc_get(child);
+	KASSERT(pp != NULL && pc != NULL);
+	KASSERT(pc->parent_id == -1);
+	pc->parent_id = parent;
+	pc->p_sibling = pp->p_children;
+	pp->p_children = pc;
+	lock_release(pid_lock);
+}
+
+/*
+ * Free an exited (or never started) process's table entry, taking it
+ * off its parent's child list. Must hold pid_lock.
+ */
+static
+void
+proc_destroy(struct process_control *pc)
+{
+	struct process_control *pp, **pcp;
+
+	KASSERT(lock_do_i_hold(pid_lock));
+	KASSERT(pc->p_children == NULL);
+
+	pp = proc_get(pc->parent_id);
+	if (pp != NULL) {
+		for (pcp = &pp->p_children; *pcp != pc;
+		     pcp = &(*pcp)->p_sibling) {
+			KASSERT(*pcp != NULL);
+		}
+		*pcp = pc->p_sibling;
+	}
+
+	lock_destroy(pc->process_lock);
+	cv_destroy(pc->p_join_cv);
+	cv_destroy(pc->p_child_cv);
+	proc_free(pc->p_pid);
+	kfree(pc);
+}
+
 void
 initialize_pid(struct thread *thr,pid_t processid)
 {
@@ -33,114 +259,237 @@ initialize_pid(struct thread *thr,pid_t processid)
 	thr->t_pid=processid;
 
 	p_array->parent_id=-1;
-	p_array->childlist=NULL;
+	p_array->p_children=NULL;
+	p_array->p_sibling=NULL;
 	p_array->exit_code=-1;
 	p_array->exit_status=false;
 	p_array->mythread=thr;
-	p_array->waitstatus=false;
-	p_array->process_sem = sem_create(thr->t_name,0);
+	bzero(&p_array->exit_usage, sizeof(p_array->exit_usage));
+	bzero(&p_array->child_usage, sizeof(p_array->child_usage));
 
 	//Create the lock and CV
 	p_array->process_lock=lock_create(thr->t_name);
-	p_array->process_cv = cv_create(thr->t_name);
+	p_array->p_child_cv = cv_create(thr->t_name);
+
+	//The thread being set up is the process's first thread
+	for (int i=0; i<THREAD_MAX; i++) {
+		p_array->p_threads[i].pt_thread = NULL;
+		p_array->p_threads[i].pt_used = false;
+		p_array->p_threads[i].pt_retval = 0;
+	}
+	p_array->p_threads[0].pt_thread = thr;
+	p_array->p_threads[0].pt_used = true;
+	p_array->p_nthreads = 1;
+	p_array->p_exitset = false;
+	p_array->p_join_cv = cv_create(thr->t_name);
+	p_array->p_sbring = NULL;
+	p_array->p_sbentries = 0;
 
 	//Copy back into the thread
-	process_array[processid]=p_array;
+	p_array->p_pid=processid;
+	proc_slot(processid % PROCESS_MAX)->ps_proc=p_array;
 
 	if(curthread!=NULL)
 		lock_release(pid_lock);
 
 }
 
+/*
+ * Take a slot off the free list and return its pid, or -1 if the
+ * table is full.
+ */
 pid_t
 allocate_pid(void)
 {
-	for(int i=PID_MIN;i<PROCESS_MAX;i++)
-	{
-		if(process_array[i]==0)
-		{
-			return i;
-			break;
+	struct proc_slot *ps;
+	pid_t pid;
+	int slot;
+
+	if(curthread!=NULL)
+		lock_acquire(pid_lock);
+
+	if (proc_freehead < 0) {
+		proc_grow();
+	}
+	slot = proc_freehead;
+	if (slot < 0) {
+		pid = -1;
+	}
+	else {
+		ps = proc_slot(slot);
+		proc_freehead = ps->ps_nextfree;
+		if (proc_freehead < 0) {
+			proc_freetail = -1;
 		}
+		ps->ps_nextfree = -1;
+		pid = ps->ps_pid;
 	}
-	return -1;
+
+	if(curthread!=NULL)
+		lock_release(pid_lock);
+
+	return pid;
 }
 
 void
 deallocate_pid(pid_t processid)
 {
+	struct process_control *pc;
 
-	if(process_array[processid]==0 || process_array[processid]==NULL)
-	{
-		//Do Nothing
-	}
-	else
-	{
-		pid_t parent_id = process_array[processid]->parent_id;
-		if(parent_id>PID_MIN)
-		{
-				int counter=0;
-				for(counter=3;counter<__OPEN_MAX;counter++)
-				{
-					if(curthread->file_table[counter]!=0)
-					{
-						process_array[parent_id]->mythread->file_table[counter]->reference_count--;
-					}
-					else
-					{
-							//newthread->file_table[counter]=0;
-					}
-				}
-		}
-
-		sem_destroy(process_array[processid]->process_sem);
-		lock_destroy(process_array[processid]->process_lock);
-		cv_destroy(process_array[processid]->process_cv);
-		kfree(process_array[processid]);
-		process_array[processid]=0;
-
+	lock_acquire(pid_lock);
+	pc = proc_get(processid);
+	if (pc != NULL) {
+		proc_destroy(pc);
 	}
+	lock_release(pid_lock);
 }
 
+/*
+ * Give THR, a new thread of process PROCESSID, a thread slot. Returns
+ * the thread id through TID, or EAGAIN if the process has THREAD_MAX
+ * threads (or unjoined exited ones) already.
+ */
 int
-sys___exit(int exit_code)
+proc_thread_add(pid_t processid, struct thread *thr, int *tid)
 {
-	//Check whether the process calling exit has no children?
+	struct process_control *pc;
+	int i;
 
-	pid_t pid_process=curthread->t_pid;
+	pc = proc_get(processid);
+	KASSERT(pc != NULL);
 
-	//Check whether to indicate exit by calling cv_broadcast as well
-//	cv_broadcast(process_array[pid_process]->process_cv,process_array[pid_process]->process_lock);
+	lock_acquire(pc->process_lock);
+	for (i=1; i<THREAD_MAX; i++) {
+		if (!pc->p_threads[i].pt_used) {
+			break;
+		}
+	}
+	if (i == THREAD_MAX) {
+		lock_release(pc->process_lock);
+		return EAGAIN;
+	}
+	pc->p_threads[i].pt_thread = thr;
+	pc->p_threads[i].pt_used = true;
+	pc->p_threads[i].pt_retval = 0;
+	pc->p_nthreads++;
+	lock_release(pc->process_lock);
 
-	//Now using a semaphore and V when the thread exits
-	if(process_array[pid_process]->waitstatus==true)
-	{
-		lock_acquire(process_array[pid_process]->process_lock);
+	*tid = i;
+	return 0;
+}
 
-		//Indicate Exit by calling changing the exit status in the process array
-		process_array[pid_process]->exit_code= _MKWAIT_EXIT(exit_code);
+/*
+ * Give back the slot of a thread that was added but never ran.
+ */
+void
+proc_thread_drop(pid_t processid, int tid)
+{
+	struct process_control *pc;
+
+	pc = proc_get(processid);
+	KASSERT(pc != NULL);
+	KASSERT(tid > 0 && tid < THREAD_MAX);
+
+	lock_acquire(pc->process_lock);
+	KASSERT(pc->p_threads[tid].pt_used);
+	pc->p_threads[tid].pt_thread = NULL;
+	pc->p_threads[tid].pt_used = false;
+	pc->p_nthreads--;
+	lock_release(pc->process_lock);
+}
 
-		process_array[pid_process]->exit_status=true;
+/*
+ * Called by thread_exit: take THR out of its process, charge its CPU
+ * time to the process, and wake up anyone joining it. If it was the
+ * last thread, the process has exited: post the exit status (a plain
+ * 0 if nobody called _exit) and wake the parent, or reap the process
+ * right away if it has no parent. Its children are orphaned, and the
+ * ones that have exited already are reaped. Returns true in that
+ * case, meaning the caller must free what the threads shared.
+ */
+bool
+proc_thread_exit(struct thread *thr)
+{
+	struct process_control *pc;
+	struct process_control *pp, *child, *next;
+	bool last;
+	int i;
+
+	lock_acquire(pid_lock);
+	pc = proc_get(thr->t_pid);
+	if (pc == NULL) {
+		lock_release(pid_lock);
+		return true;
+	}
 
-		cv_signal(process_array[pid_process]->process_cv,process_array[pid_process]->process_lock);
+	lock_acquire(pc->process_lock);
+	KASSERT(pc->p_threads[thr->t_tid].pt_thread == thr);
+	pc->p_threads[thr->t_tid].pt_thread = NULL;
+	KASSERT(pc->p_nthreads > 0);
+	pc->p_nthreads--;
+	last = (pc->p_nthreads == 0);
+
+	/* Nobody may look at this thread once it's been destroyed. */
+	if (pc->mythread == thr) {
+		pc->mythread = NULL;
+		for (i=0; i<THREAD_MAX; i++) {
+			if (pc->p_threads[i].pt_thread != NULL) {
+				pc->mythread = pc->p_threads[i].pt_thread;
+				break;
+			}
+		}
+	}
 
-		lock_release(process_array[pid_process]->process_lock);
+	thread_usage_add(&pc->exit_usage, &thr->t_usage);
+	cv_broadcast(pc->p_join_cv, pc->process_lock);
 
+	if (last) {
+		if (!pc->p_exitset) {
+			pc->exit_code = _MKWAIT_EXIT(0);
+		}
+		pc->exit_status = true;
 	}
-		//V(process_array[pid_process]->process_sem);
-	else
-	{
-		lock_acquire(process_array[pid_process]->process_lock);
+	lock_release(pc->process_lock);
+
+	if (last) {
+		for (child = pc->p_children; child != NULL; child = next) {
+			next = child->p_sibling;
+			child->parent_id = -1;
+			child->p_sibling = NULL;
+			if (child->exit_status) {
+				proc_destroy(child);
+			}
+		}
+		pc->p_children = NULL;
 
-		//Store the exit code passed in the argument
-		process_array[pid_process]->exit_code= _MKWAIT_EXIT(exit_code);
+		pp = proc_get(pc->parent_id);
+		if (pp != NULL) {
+			cv_broadcast(pp->p_child_cv, pid_lock);
+		}
+		else {
+			proc_destroy(pc);
+		}
+	}
+	lock_release(pid_lock);
 
-		//Indicate Exit by calling changing the exit status in the process array
-		process_array[pid_process]->exit_status=true;
+	return last;
+}
 
-		lock_release(process_array[pid_process]->process_lock);
+int
+sys___exit(int exit_code)
+{
+	pid_t pid_process=curthread->t_pid;
 
-	}
+	/*
+	 * Record the exit code. The process is finished, and the parent
+	 * is woken up, once its last thread is gone; see
+	 * proc_thread_exit. Other threads aren't killed, so a threaded
+	 * program should join its threads before exiting.
+	 */
+	lock_acquire(proc_get(pid_process)->process_lock);
+	proc_get(pid_process)->exit_code= _MKWAIT_EXIT(exit_code);
+	proc_get(pid_process)->p_exitset=true;
+	lock_release(proc_get(pid_process)->process_lock);
 
 	thread_exit();
 
@@ -154,158 +503,108 @@ sys___getpid(int32_t *retval)
 	return 0;
 }
 
+/*
+ * Reap a child that has exited. PID is the child's pid, or WAIT_ANY
+ * for whichever child exits first. Sleeps until there is one, unless
+ * OPTIONS has WNOHANG, in which case *RETVAL is 0 if there isn't.
+ * Otherwise *RETVAL is the child's pid, and its exit status is stored
+ * in USTATUS if that's not NULL, or else in *KSTATUS. If the status
+ * can't be stored the child is left for another try.
+ */
+static
 int
-sys___waitpid(int processid,userptr_t  status,int options, int32_t *retval)
+proc_wait(pid_t pid, int options, userptr_t ustatus, int *kstatus,
+	  int32_t *retval)
 {
-	int exit_code;
+	struct process_control *me, *pc;
 	int result;
 
-	if( options!=0){
+	if (options & ~WNOHANG) {
 		return EINVAL;
 	}
-	//Check whether the pid exists
-	if(processid<PID_MIN || process_array[processid]==0 ||process_array[processid]==NULL)
-	{
-		return ESRCH;
-	}
-
-	//CHeck if the status is not NULL
-	if(status==NULL)
-		return EFAULT;
-
-	if (processid < PID_MIN)
-		return EINVAL;
-
-	if(processid > PID_MAX)
-		return ESRCH;
-
-	if (processid == curthread->t_pid)
-		return ECHILD;
-
-
-	if(!(curthread->t_pid == process_array[processid]->parent_id))
+	if (pid == curthread->t_pid) {
 		return ECHILD;
+	}
 
+	lock_acquire(pid_lock);
+	me = proc_get(curthread->t_pid);
+	KASSERT(me != NULL);
 
-	if(process_array[processid]->exit_status==true)
-	{
-		lock_acquire(process_array[processid]->process_lock);
-
-		exit_code = process_array[processid]->exit_code;
-
-		lock_release(process_array[processid]->process_lock);
+	while (1) {
+		if (pid == WAIT_ANY) {
+			if (me->p_children == NULL) {
+				lock_release(pid_lock);
+				return ECHILD;
+			}
+			for (pc = me->p_children; pc != NULL;
+			     pc = pc->p_sibling) {
+				if (pc->exit_status) {
+					break;
+				}
+			}
+		}
+		else {
+			/* Look it up each time; another thread may reap it */
+			pc = proc_get(pid);
+			if (pc == NULL) {
+				lock_release(pid_lock);
+				return ESRCH;
+			}
+			if (pc->parent_id != me->p_pid) {
+				lock_release(pid_lock);
+				return ECHILD;
+			}
+			if (!pc->exit_status) {
+				pc = NULL;
+			}
+		}
+		if (pc != NULL) {
+			break;
+		}
+		if (options & WNOHANG) {
+			lock_release(pid_lock);
+			*retval = 0;
+			return 0;
+		}
+		cv_wait(me->p_child_cv, pid_lock);
+	}
 
-		result = copyout(&exit_code,status,sizeof(userptr_t));
-		if(result)
+	if (ustatus != NULL) {
+		result = copyout(&pc->exit_code, ustatus, sizeof(int));
+		if (result) {
+			lock_release(pid_lock);
 			return result;
-
-		//Destroy Child's Process Structure - Call deallocate_pid
-
-		*retval = processid;
-		deallocate_pid(processid);
-
+		}
 	}
-	else if(process_array[processid]->exit_status==false)
-	{
-		lock_acquire(process_array[processid]->process_lock);
-
-		process_array[processid]->waitstatus=true;
-		cv_wait(process_array[processid]->process_cv,process_array[processid]->process_lock);
-
-		//P(process_array[pid_process]->process_sem);
-		exit_code = process_array[processid]->exit_code;
-
-		lock_release(process_array[processid]->process_lock);
-
-		result = copyout(&exit_code,status,sizeof(userptr_t));
-			if(result)
-					return result;
-
-		//Destroy Child's Process Structure - Call deallocate_pid
-
-		*retval = processid;
-		deallocate_pid(processid);
+	else {
+		*kstatus = pc->exit_code;
 	}
 
-		return 0;
+	*retval = pc->p_pid;
+	proc_reap_usage(me, pc);
+	proc_destroy(pc);
+	lock_release(pid_lock);
+
+	return 0;
 }
 
 int
-sys___kwaitpid(int processid,int *status,int options, int32_t *retval)
+sys___waitpid(int processid,userptr_t  status,int options, int32_t *retval)
 {
-	int exit_code;
-
-	if( options!=0){
-		return EINVAL;
-	}
-	//Check whether the pid exists
-	if(processid<PID_MIN || process_array[processid]==0 ||process_array[processid]==NULL)
-	{
-		return ESRCH;
-	}
-
 	//CHeck if the status is not NULL
 	if(status==NULL)
 		return EFAULT;
 
-	if (processid < PID_MIN)
-		return EINVAL;
-
-	if(processid > PID_MAX)
-		return ESRCH;
-
-	if (processid == curthread->t_pid)
-		return ECHILD;
-
-
-	if(!(curthread->t_pid == process_array[processid]->parent_id))
-		return ECHILD;
-
-	if(process_array[processid]->exit_status==true)
-	{
-		lock_acquire(process_array[processid]->process_lock);
-
-		exit_code = process_array[processid]->exit_code;
-
-		lock_release(process_array[processid]->process_lock);
-
-		status = &exit_code;
-
-	/*	result = copyout(&exit_code,status,sizeof(userptr_t));
-		if(result)
-			return result;
-*/
-		//Destroy Child's Process Structure - Call deallocate_pid
-
-		*retval = processid;
-		deallocate_pid(processid);
-
-	}
-	else if(process_array[processid]->exit_status==false)
-	{
-		lock_acquire(process_array[processid]->process_lock);
-
-		process_array[processid]->waitstatus=true;
-		cv_wait(process_array[processid]->process_cv,process_array[processid]->process_lock);
-
-		//P(process_array[pid_process]->process_sem);
-		exit_code = process_array[processid]->exit_code;
-
-		lock_release(process_array[processid]->process_lock);
-
-		status = &exit_code;
-
-		/*result = copyout(&exit_code,status,sizeof(userptr_t));
-			if(result)
-					return result;
-*/
-		//Destroy Child's Process Structure - Call deallocate_pid
+	return proc_wait(processid, options, status, NULL, retval);
+}
 
-		*retval = processid;
-		deallocate_pid(processid);
-	}
+int
+sys___kwaitpid(int processid,int *status,int options, int32_t *retval)
+{
+	if(status==NULL)
+		return EFAULT;
 
-		return 0;
+	return proc_wait(processid, options, NULL, status, retval);
 }
 
 
@@ -342,13 +641,13 @@ sys___fork(struct trapframe *tf, pid_t *returnval)
 	result = thread_fork(curthread->t_name,enter_process,parent_tf,parent_pid,&child);
 	if(result){
 	//	kfree(parent_tf);
-	/*	if(process_array[child->t_pid] == 0 || process_array[child->t_pid] == NULL)
+	/*	if(proc_get(child->t_pid) == 0 || proc_get(child->t_pid) == NULL)
 		{
 			//Do Nothing
 		}
 		else
 		{
-			kfree(process_array[child->t_pid]);
+			kfree(proc_get(child->t_pid));
 		}
 
 	//*/
@@ -384,9 +683,8 @@ enter_process(void *tf,unsigned long addr)
 		child_tf.tf_epc +=4;
 
 
-		pid_t parentid = (pid_t)addr;
-		if(process_array[curthread->t_pid]->parent_id!=parentid)
-			process_array[curthread->t_pid]->parent_id=parentid;
+		//thread_fork has already linked us to our parent
+		(void)addr;
 
 		if(!(curthread->t_addrspace==NULL))
 		{
@@ -398,183 +696,491 @@ enter_process(void *tf,unsigned long addr)
 }
 
 
+/*
+ * Copy in the argument vector AR. The result is packed into one
+ * ARG_MAX buffer laid out the way it goes on the new user stack: the
+ * argv pointer array, NULL-terminated, followed by the strings. Until
+ * the stack address is known the pointers hold offsets into the
+ * string area. Returns the buffer, the argument count and the string
+ * bytes used; E2BIG if it doesn't all fit.
+ */
+static
+int
+execv_copyinargs(char **ar, char **buf_ret, int *argc_ret, size_t *strsize_ret)
+{
+	char *buf;
+	userptr_t *argv;
+	char *strings;
+	size_t argvsize, used, len, max;
+	int argc, i, result;
+
+	buf = kmalloc(ARG_MAX);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	argv = (userptr_t *)buf;
+
+	/* First the user's pointers, up to and including the NULL */
+	argc = 0;
+	while (1) {
+		if ((argc + 1) * sizeof(userptr_t) > ARG_MAX) {
+			kfree(buf);
+			return E2BIG;
+		}
+		result = copyin((const_userptr_t)&ar[argc], &argv[argc],
+				sizeof(userptr_t));
+		if (result) {
+			kfree(buf);
+			return result;
+		}
+		if (argv[argc] == NULL) {
+			break;
+		}
+		argc++;
+	}
+	argvsize = (argc + 1) * sizeof(userptr_t);
+
+	/* Then the strings, packed right after the array */
+	strings = buf + argvsize;
+	used = 0;
+	for (i=0; i<argc; i++) {
+		max = ARG_MAX - argvsize - used;
+		result = copyinstr((const_userptr_t)argv[i], strings + used,
+				   max, &len);
+		if (result == ENAMETOOLONG) {
+			result = E2BIG;
+		}
+		if (result) {
+			kfree(buf);
+			return result;
+		}
+		argv[i] = (userptr_t)used;
+		used += len;
+	}
+
+	*buf_ret = buf;
+	*argc_ret = argc;
+	*strsize_ret = used;
+	return 0;
+}
+
+/*
+ * Replace the current thread's address space with the program in V,
+ * with the arguments from execv_copyinargs on its stack. On success
+ * the old address space is gone and the entry point and user argv
+ * address are handed back; on failure nothing has changed. Neither V
+ * nor ARGBUF is consumed, but ARGBUF's argv is left pointing into the
+ * new stack.
+ */
+static
+int
+exec_image(struct vnode *v, char *argbuf, int argc, size_t strsize,
+	   vaddr_t *entrypoint_ret, vaddr_t *argvptr_ret)
+{
+	struct addrspace *oldas, *newas;
+	vaddr_t stackptr, entrypoint, argvptr;
+	userptr_t *argv;
+	size_t argvsize, total;
+	int i, result;
+
+	/*
+	 * Load into a new address space, keeping the old one until
+	 * that works so a failed exec can still return.
+	 */
+	newas = as_create();
+	if (newas == NULL) {
+		return ENOMEM;
+	}
+	oldas = curthread->t_addrspace;
+	curthread->t_addrspace = newas;
+	as_activate(newas);
+
+	result = load_elf(v, &entrypoint);
+	if (result == 0) {
+		result = as_define_stack(newas, &stackptr);
+	}
+	if (result) {
+		goto fail;
+	}
+
+	/*
+	 * Point argv at where the strings will be and copy the whole
+	 * block out at once, keeping the stack 8-byte aligned.
+	 */
+	argvsize = (argc + 1) * sizeof(userptr_t);
+	total = ROUNDUP(argvsize + strsize, 8);
+	argvptr = stackptr - total;
+	argv = (userptr_t *)argbuf;
+	for (i=0; i<argc; i++) {
+		argv[i] = (userptr_t)(argvptr + argvsize + (vaddr_t)argv[i]);
+	}
+	result = copyout(argbuf, (userptr_t)argvptr, argvsize + strsize);
+	if (result) {
+		goto fail;
+	}
+
+	if (oldas != NULL) {
+		as_destroy(oldas);
+	}
+
+	/* Any batch ring was in the old image */
+	proc_get(curthread->t_pid)->p_sbring = NULL;
+
+	*entrypoint_ret = entrypoint;
+	*argvptr_ret = argvptr;
+	return 0;
+
+ fail:
+	curthread->t_addrspace = oldas;
+	as_activate(oldas);
+	as_destroy(newas);
+	return result;
+}
+
+/*
+ * Copy in a program name and argument vector and open the program.
+ */
+static
+int
+exec_prepare(userptr_t uname, char **ar, struct vnode **v_ret,
+	     char **argbuf_ret, int *argc_ret, size_t *strsize_ret)
+{
+	char *kname;
+	size_t copied_length;
+	int result;
+
+	if (uname == NULL || ar == NULL) {
+		return EFAULT;
+	}
+
+	kname = kmalloc(PATH_MAX);
+	if (kname == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr((const_userptr_t)uname, kname, PATH_MAX,
+			   &copied_length);
+	if (result == 0 && copied_length == 1) {
+		result = EINVAL;
+	}
+	if (result == 0) {
+		result = execv_copyinargs(ar, argbuf_ret, argc_ret,
+					  strsize_ret);
+	}
+	if (result) {
+		kfree(kname);
+		return result;
+	}
+
+	result = vfs_open(kname, O_RDONLY, 0, v_ret);
+	kfree(kname);
+	if (result) {
+		kfree(*argbuf_ret);
+		return result;
+	}
+	return 0;
+}
+
 int
 sys___execv(char * p_name,char **ar )
 {
 	struct vnode *p_vnode;
-		vaddr_t  stackptr;
-		vaddr_t entrypoint;
+	vaddr_t entrypoint, argvptr;
+	char *argbuf;
+	size_t strsize;
+	int argc, result;
+
+	//The other threads would be left running in a dead image
+	if(proc_get(curthread->t_pid)->p_nthreads > 1)
+		return EBUSY;
+
+	result = exec_prepare((userptr_t)p_name, ar, &p_vnode, &argbuf,
+			      &argc, &strsize);
+	if (result) {
+		return result;
+	}
 
-		int result;
-		size_t copied_length;
-		char *kname;
+	result = exec_image(p_vnode, argbuf, argc, strsize,
+			    &entrypoint, &argvptr);
+	vfs_close(p_vnode);
+	kfree(argbuf);
+	if (result) {
+		return result;
+	}
 
-		if(p_name==NULL)
-			return EFAULT;
+	/* Warp to user mode. */
+	enter_new_process(argc, (userptr_t)argvptr, argvptr, entrypoint);
 
-		if(ar==NULL)
-			return EFAULT;
+	/* enter_new_process does not return. */
+	panic("enter_new_process returned\n");
+	return EINVAL;
+}
 
-		if(p_name == '\0')
-			return ENOEXEC;
+/*
+ * spawn: start a program in a new child process.
+ *
+ * Instead of copying our address space only to throw it away, the
+ * child is made with no address space and loads the program itself.
+ * The parent waits until the child has either got as far as entering
+ * user mode or failed, so that errors (including ones from loading)
+ * come back to the caller of spawn, and the failed child is reaped.
+ */
+struct spawnargs {
+	struct vnode *sa_vnode;
+	char *sa_argbuf;
+	int sa_argc;
+	size_t sa_strsize;
+	struct semaphore *sa_done;
+	int sa_result;
+};
 
+static
+void
+spawn_start(void *data, unsigned long junk)
+{
+	struct spawnargs *sa = data;
+	vaddr_t entrypoint, argvptr;
+	int argc, result;
 
-		kname = (char *) kmalloc(sizeof(p_name));
-		result = copyinstr((const_userptr_t)p_name,kname,NAME_MAX,&copied_length);
-		if(copied_length == 1)
-		{
-			kfree(kname);
-			return EINVAL;
-		}
-		if(result)
-		{
-			kfree(kname);
-			return result;
-		}
+	(void)junk;
 
-		char **karguments1 = kmalloc(100*sizeof(char*));
-		result = copyin((const_userptr_t) ar,karguments1,(100*sizeof(char*)));
-		if(result)
-		{
-			kfree(karguments1);
-			kfree(kname);
-			return result;
-		}
-		else
-			kfree(karguments1);
+	argc = sa->sa_argc;
+	result = exec_image(sa->sa_vnode, sa->sa_argbuf, argc,
+			    sa->sa_strsize, &entrypoint, &argvptr);
 
-		char **arguments_kernel =(char **) kmalloc(sizeof(char**));
-		result = copyin((const_userptr_t) ar,arguments_kernel,(sizeof(char**)));
-		if(result)
-		{
-			kfree(kname);
-			kfree(arguments_kernel);
-			return result;
+	/* Our parent cleans up SA as soon as we signal */
+	sa->sa_result = result;
+	V(sa->sa_done);
 
-		}
+	if (result) {
+		sys___exit(127);
+	}
 
-		char **karguments = (char **) kmalloc(sizeof(char **));
+	enter_new_process(argc, (userptr_t)argvptr, argvptr, entrypoint);
+	panic("enter_new_process returned\n");
+}
 
-		int counter=0;
-		size_t actual_lenght1;
-		while(!(ar[counter]==NULL))
-		{
-			int string_length = strlen(ar[counter])+1;
-			karguments[counter] = (char *) kmalloc(sizeof(char) * string_length);
-			result = copyinstr((const_userptr_t) ar[counter],karguments[counter],string_length,&actual_lenght1);
-			if(result)
-			{
-				kfree(kname);
-				kfree(arguments_kernel);
-				return result;
-			}
+/*
+ * Build the file table for a spawned child: fd I gets our fd
+ * FDMAP[I], or is left closed if that is -1.
+ */
+static
+int
+spawn_fdtable(userptr_t ufdmap, int nfds, struct fdtable **ret)
+{
+	struct fdtable *fdt;
+	struct openfile *of, *oldof;
+	int i, fd, result;
 
-			counter++;
+	if (nfds < 0 || nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	fdt = fdtable_create();
+	if (fdt == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<nfds; i++) {
+		result = copyin((const_userptr_t)((vaddr_t)ufdmap +
+						  i * sizeof(int)),
+				&fd, sizeof(fd));
+		if (result) {
+			fdtable_destroy(fdt);
+			return result;
 		}
-		karguments[counter] = NULL;
+		if (fd == -1) {
+			continue;
+		}
+		result = fdtable_get(curthread->file_table, fd, &of);
+		if (result == 0) {
+			result = fdtable_install(fdt, i, of, &oldof);
+			if (result) {
+				openfile_decref(of);
+			}
+		}
+		if (result) {
+			fdtable_destroy(fdt);
+			return result;
+		}
+		KASSERT(oldof == NULL);
+	}
+	*ret = fdt;
+	return 0;
+}
 
-		result = vfs_open(kname, O_RDONLY, 0, &p_vnode);
+int
+sys_spawn(userptr_t prog, userptr_t args, userptr_t fdmap, int nfds,
+	  int32_t *retval)
+{
+	struct spawnargs sa;
+	struct fdtable *fdt;
+	struct thread *child;
+	pid_t pid;
+	int result, status;
+	int32_t junk;
+
+	/* Without a map, the child gets a copy of our whole table */
+	fdt = NULL;
+	if (fdmap != NULL) {
+		result = spawn_fdtable(fdmap, nfds, &fdt);
 		if (result) {
 			return result;
 		}
+	}
 
-		as_destroy(curthread->t_addrspace);
+	result = exec_prepare(prog, (char **)args, &sa.sa_vnode,
+			      &sa.sa_argbuf, &sa.sa_argc, &sa.sa_strsize);
+	if (result) {
+		goto out_fdt;
+	}
 
-		//Create a new address space.
-		curthread->t_addrspace = as_create();
-		if (curthread->t_addrspace==NULL)
-		{
-			vfs_close(p_vnode);
-			return ENOMEM;
-		}
+	sa.sa_done = sem_create("spawn", 0);
+	if (sa.sa_done == NULL) {
+		result = ENOMEM;
+		goto out_prog;
+	}
+	sa.sa_result = 0;
 
-		//Activate it.
-		as_activate(curthread->t_addrspace);
+	result = thread_fork_noas(curthread->t_name, spawn_start, &sa, 0,
+				  fdt, &child);
+	if (result) {
+		goto out_sem;
+	}
+	pid = child->t_pid;
 
-		/* Load the executable. */
-		result = load_elf(p_vnode, &entrypoint);
-		if (result)
-		{
-			/* thread_exit destroys curthread->t_addrspace */
-			vfs_close(p_vnode);
-			return result;
-		}
+	/* The child got the file table, if there was one */
+	fdt = NULL;
 
-		/* Done with the file now. */
-		vfs_close(p_vnode);
+	P(sa.sa_done);
+	result = sa.sa_result;
+	if (result) {
+		proc_wait(pid, 0, NULL, &status, &junk);
+	}
+	else {
+		*retval = pid;
+	}
 
-		//Get the pointer to the stack starting
-		result = as_define_stack(curthread->t_addrspace, &stackptr);
-		if (result)
-		{
-			/* thread_exit destroys curthread->t_addrspace */
-			return result;
-		}
+ out_sem:
+	sem_destroy(sa.sa_done);
+ out_prog:
+	vfs_close(sa.sa_vnode);
+	kfree(sa.sa_argbuf);
+ out_fdt:
+	if (fdt != NULL) {
+		fdtable_destroy(fdt);
+	}
+	return result;
+}
 
-		//Now copy the arguments
-		int count =0;
-		char **karray= kmalloc(sizeof(char**));
-		size_t final_stack=0;
+/*
+ * Start a new thread of the calling process, running ENTRY(ARG) on
+ * STACK. ARG comes in as the third argument register. Returns the new
+ * thread's id.
+ */
+static
+void
+enter_thread(void *tf, unsigned long junk)
+{
+	struct trapframe thread_tf;
 
-		while(karguments[count] != NULL)
-		{
-			int string_length = strlen(karguments[count])+1;
-			char *k_des= karguments[count];
-
-			int new_length = string_length;
-			if((string_length) % 4 != 0)
-			{
-				while(new_length%4 !=0)
-				{
-					new_length++;
-				}
-				for(int i=string_length;i<=new_length;i++)
-				{
-					k_des[i]= '\0';
-				}
-			}
+	(void)junk;
 
-			//Argument aligned by 4
+	memcpy(&thread_tf, tf, sizeof(struct trapframe));
+	kfree(tf);
 
-			size_t final_length= (size_t)new_length;
+	as_activate(curthread->t_addrspace);
+	mips_usermode(&thread_tf);
+}
 
-			if(count==0)
-			{
-				final_stack= stackptr- final_length;
-			}
-			else
-			{
-				final_stack= (size_t)karray[count-1]- final_length;
-			}
+int
+sys___threadcreate(struct trapframe *tf, userptr_t entry, userptr_t stack,
+		   int32_t *retval)
+{
+	struct trapframe *newtf;
+	int result, tid;
 
-			size_t actual_length1;
-			result= copyoutstr(k_des, (userptr_t) (final_stack), final_length, &actual_length1);
-			if(result)
-			{
-				return result;
-			}
+	if (entry == NULL || (vaddr_t)entry >= USERSPACETOP ||
+	    stack == NULL || (vaddr_t)stack >= USERSPACETOP) {
+		return EFAULT;
+	}
 
-			karray[count]=  (char*)(final_stack);
+	newtf = kmalloc(sizeof(struct trapframe));
+	if (newtf == NULL) {
+		return ENOMEM;
+	}
+	memcpy(newtf, tf, sizeof(struct trapframe));
+	newtf->tf_epc = (vaddr_t)entry;
+	newtf->tf_sp = (vaddr_t)stack;
+	newtf->tf_a0 = tf->tf_a2;
+
+	result = thread_fork_sibling(curthread->t_name, enter_thread, newtf, 0,
+				     &tid);
+	if (result) {
+		kfree(newtf);
+		return result;
+	}
 
-			count++;
-		} //End of While
+	*retval = tid;
+	return 0;
+}
 
-		karray[count]= (char*)NULL;
-		int value= count+1;
-		int arr_length = (value+1)*sizeof(char*);
-		final_stack= (size_t)karray[count-1]- arr_length;
-		result= copyout(karray, (userptr_t) (final_stack),arr_length);
-		if(result)
-		{
-			return result;
-		}
+/*
+ * Exit the calling thread, leaving RETVAL for whoever joins it. If it
+ * is the last thread, the process exits with status 0.
+ */
+int
+sys_threadexit(int retval)
+{
+	struct process_control *pc;
 
+	pc = proc_get(curthread->t_pid);
+	lock_acquire(pc->process_lock);
+	pc->p_threads[curthread->t_tid].pt_retval = retval;
+	lock_release(pc->process_lock);
 
-			/* Warp to user mode. */
-				enter_new_process(count /*argc*/, (userptr_t)(final_stack) /*userspace addr of argv*/,
-						final_stack, entrypoint);
+	thread_exit();
 
-		return 0;
+	return 0;
+}
+
+/*
+ * Wait for thread TID of the calling process to exit, and free its
+ * slot. Its threadexit value is stored in STATUS if that isn't NULL.
+ */
+int
+sys___threadjoin(int tid, userptr_t status)
+{
+	struct process_control *pc;
+	int retval;
+
+	if (tid < 0 || tid >= THREAD_MAX) {
+		return ESRCH;
+	}
+	if (tid == curthread->t_tid) {
+		return EINVAL;
+	}
+
+	pc = proc_get(curthread->t_pid);
+	lock_acquire(pc->process_lock);
+	if (!pc->p_threads[tid].pt_used) {
+		lock_release(pc->process_lock);
+		return ESRCH;
+	}
+	while (pc->p_threads[tid].pt_thread != NULL) {
+		cv_wait(pc->p_join_cv, pc->process_lock);
+		if (!pc->p_threads[tid].pt_used) {
+			/* Somebody else joined it first */
+			lock_release(pc->process_lock);
+			return ESRCH;
+		}
+	}
+	retval = pc->p_threads[tid].pt_retval;
+	pc->p_threads[tid].pt_used = false;
+	lock_release(pc->process_lock);
+
+	if (status != NULL) {
+		return copyout(&retval, status, sizeof(int));
+	}
+	return 0;
 }
 
 int
@@ -585,7 +1191,7 @@ sys___sbrk(int amount, int *retval)
 
 	struct addrspace *as = curthread->t_addrspace;
 
-	if(as->heap_end+amount > 0x40000000)
+	if(as->heap_end+amount > MMAP_BASE)
 		return ENOMEM;
 
 
@@ -608,5 +1214,157 @@ sys___sbrk(int amount, int *retval)
 return 0;
 }
 
-//End of Additions by PM
+/*
+ * mmap: only anonymous private mappings, at an address the kernel
+ * picks (ADDR is ignored, as a hint may be). The pages are zero-filled
+ * on first touch.
+ */
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	 off_t offset, int *retval)
+{
+	vaddr_t va;
+	int result;
+
+	(void)addr;
+
+	if (flags != (MAP_ANON|MAP_PRIVATE) || fd != -1 || offset != 0) {
+		return EINVAL;
+	}
+	if ((prot & ~(PROT_READ|PROT_WRITE|PROT_EXEC)) != 0) {
+		return EINVAL;
+	}
+
+	result = as_map_anon(curthread->t_addrspace, len, prot, &va);
+	if (result) {
+		return result;
+	}
+	*retval = (int)va;
+	return 0;
+}
+
+int
+sys_munmap(userptr_t addr, size_t len)
+{
+	return as_unmap(curthread->t_addrspace, (vaddr_t)addr, len);
+}
+
+/*
+ * Convert a tick count to a struct timeval.
+ */
+static
+void
+clocks_to_timeval(unsigned clocks, struct timeval *tv)
+{
+	uint64_t usec;
+
+	usec = HARDCLOCKS_TO_USEC(clocks);
+	tv->tv_sec = usec / 1000000;
+	tv->tv_usec = usec % 1000000;
+}
+
+/*
+ * Total CPU usage of PC so far: what its exited threads left in
+ * exit_usage, plus that of each live thread. Must hold process_lock.
+ */
+static
+void
+proc_usage(struct process_control *pc, struct thread_usage *tu)
+{
+	struct thread *t;
+	unsigned i;
+
+	KASSERT(lock_do_i_hold(pc->process_lock));
+
+	*tu = pc->exit_usage;
+	for (i=0; i<THREAD_MAX; i++) {
+		t = pc->p_threads[i].pt_thread;
+		if (t != NULL) {
+			thread_usage_add(tu, &t->t_usage);
+		}
+	}
+}
 
+/*
+ * getrusage: report CPU time and context switch counts for the
+ * calling process (RUSAGE_SELF) or its reaped children
+ * (RUSAGE_CHILDREN). The other rusage fields are not tracked and
+ * come back as zero.
+ */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+	struct process_control *pc;
+	struct thread_usage tu;
+	struct rusage ru;
+
+	pc = proc_get(curthread->t_pid);
+	switch (who) {
+	    case RUSAGE_SELF:
+		lock_acquire(pc->process_lock);
+		proc_usage(pc, &tu);
+		lock_release(pc->process_lock);
+		break;
+	    case RUSAGE_CHILDREN:
+		tu = pc->child_usage;
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	bzero(&ru, sizeof(ru));
+	clocks_to_timeval(tu.tu_uclocks, &ru.ru_utime);
+	clocks_to_timeval(tu.tu_sclocks, &ru.ru_stime);
+	ru.ru_nvcsw = tu.tu_nvcsw;
+	ru.ru_nivcsw = tu.tu_nivcsw;
+
+	return copyout(&ru, usage, sizeof(ru));
+}
+
+/*
+ * Print the process table, for the kernel menu's ps command.
+ */
+void
+proc_printps(void)
+{
+	static const char *const statenames[] = {
+		"run", "ready", "sleep", "zombie",
+	};
+	struct process_control *pc;
+	struct thread *t;
+	struct thread_usage tu;
+	unsigned long utime, stime;
+	unsigned i;
+
+	kprintf("  PID  PPID STATE  CPU   USER(ms)    SYS(ms)  "
+		"  VCSW   IVCSW NAME\n");
+
+	lock_acquire(pid_lock);
+	for (i=0; i<proc_nslots; i++) {
+		pc = proc_slot(i)->ps_proc;
+		if (pc == NULL) {
+			continue;
+		}
+
+		/* Times are for the whole process; the rest for mythread */
+		lock_acquire(pc->process_lock);
+		proc_usage(pc, &tu);
+		t = pc->mythread;
+		utime = HARDCLOCKS_TO_USEC(tu.tu_uclocks) / 1000;
+		stime = HARDCLOCKS_TO_USEC(tu.tu_sclocks) / 1000;
+		if (t == NULL) {
+			kprintf("%5d %5d %-6s   -  %9lu  %9lu %7u %7u %s\n",
+				pc->p_pid, pc->parent_id, "exited", utime, stime,
+				tu.tu_nvcsw, tu.tu_nivcsw, "-");
+		}
+		else {
+			kprintf("%5d %5d %-6s %3u  %9lu  %9lu %7u %7u %s\n",
+				pc->p_pid, pc->parent_id, statenames[t->t_state],
+				t->t_cpu != NULL ? t->t_cpu->c_number : 0,
+				utime, stime, tu.tu_nvcsw, tu.tu_nivcsw,
+				t->t_name);
+		}
+		lock_release(pc->process_lock);
+	}
+	lock_release(pid_lock);
+}
@@ -139,12 +139,9 @@ runprogram(char *progname)
 		return result;
 	}
 
-	int result1=100;
-	//kprintf("Inside run program");
-	result1= intialize_file_desc_tbl(curthread->file_table);
-	if( intialize_file_desc_tbl(curthread->file_table)){
-		kprintf("Error");
-		return result1;
+	result = intialize_file_desc_tbl(curthread->file_table);
+	if (result) {
+		return result;
 	}
 
 	/* Warp to user mode. */
@@ -0,0 +1,197 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscall.h>
+#include <kern/sysbatch.h>
+#include <lib.h>
+#include <thread.h>
+#include <current.h>
+#include <copyinout.h>
+#include <vm.h>
+#include <psyscall.h>
+#include <file_syscall.h>
+#include <sysbatch.h>
+
+/*
+ * Batched system calls.
+ *
+ * The ring stays in user memory and the kernel works on it in place
+ * with copyin and copyout, reading the header once per sysbatch_enter
+ * and writing back only the indexes it owns (sb_sqhead and
+ * sb_cqtail), so the caller can keep queueing meanwhile. Each call in
+ * the batch goes through the same code as its trap would.
+ */
+
+/*
+ * Register RING, of ENTRIES entries, or forget the ring if RING is
+ * NULL. The header is (re)initialized.
+ */
+int
+sys_sysbatch_setup(userptr_t ring, unsigned entries)
+{
+	struct process_control *pc = proc_get(curthread->t_pid);
+	struct sysbatch_ring hdr;
+	vaddr_t start = (vaddr_t)ring;
+	size_t size;
+	int result;
+
+	if (ring == NULL) {
+		pc->p_sbring = NULL;
+		pc->p_sbentries = 0;
+		return 0;
+	}
+
+	if (entries == 0 || entries > SYSBATCH_MAX ||
+	    (entries & (entries - 1)) != 0) {
+		return EINVAL;
+	}
+	if (start % sizeof(__i64) != 0) {
+		return EINVAL;
+	}
+	size = SYSBATCH_SIZE(entries);
+	if (start + size < start || start + size > USERSPACETOP) {
+		return EFAULT;
+	}
+
+	bzero(&hdr, sizeof(hdr));
+	hdr.sb_entries = entries;
+	result = copyout(&hdr, ring, sizeof(hdr));
+	if (result) {
+		return result;
+	}
+
+	pc->p_sbring = ring;
+	pc->p_sbentries = entries;
+	return 0;
+}
+
+/*
+ * Run one call and fill in its completion.
+ */
+static
+void
+sysbatch_run(const struct sysbatch_sqe *sqe, struct sysbatch_cqe *cqe)
+{
+	int rv = 0;
+	off_t pos = 0;
+	int err;
+
+	switch (sqe->sqe_op) {
+	    case SYS_read:
+		err = sys_read(sqe->sqe_fd, sqe->sqe_addr, sqe->sqe_len, &rv);
+		pos = rv;
+		break;
+
+	    case SYS_write:
+		err = sys_write(sqe->sqe_fd, sqe->sqe_addr, sqe->sqe_len, &rv);
+		pos = rv;
+		break;
+
+	    case SYS_lseek:
+		err = file_lseek(sqe->sqe_fd, sqe->sqe_off, sqe->sqe_flags,
+				 &pos);
+		break;
+
+	    case SYS_open:
+		err = sys_open(sqe->sqe_addr, sqe->sqe_flags, &rv);
+		pos = rv;
+		break;
+
+	    case SYS_close:
+		err = sys_close(sqe->sqe_fd);
+		break;
+
+	    default:
+		err = ENOSYS;
+		break;
+	}
+
+	cqe->cqe_res = err ? -1 : pos;
+	cqe->cqe_err = err;
+	cqe->cqe_data = sqe->sqe_data;
+}
+
+/*
+ * Run up to COUNT queued calls, as many as there are and as the
+ * completion ring has room for. Returns how many were run.
+ */
+int
+sys_sysbatch_enter(unsigned count, int32_t *retval)
+{
+	struct process_control *pc = proc_get(curthread->t_pid);
+	struct sysbatch_ring *ur, hdr;
+	struct sysbatch_cqe *ucqes;
+	struct sysbatch_sqe sqe;
+	struct sysbatch_cqe cqe;
+	unsigned entries, mask, n, done, consumed;
+	int result, result2;
+	bool lostcqe;
+
+	/* Only address arithmetic is done on ur; all access is copyin/out */
+	ur = (struct sysbatch_ring *)pc->p_sbring;
+	if (ur == NULL) {
+		return EINVAL;
+	}
+	entries = pc->p_sbentries;
+	mask = entries - 1;
+	ucqes = (struct sysbatch_cqe *)(ur->sb_sqes + entries);
+
+	result = copyin((const_userptr_t)ur, &hdr, sizeof(hdr));
+	if (result) {
+		return result;
+	}
+	if (hdr.sb_sqtail - hdr.sb_sqhead > entries ||
+	    hdr.sb_cqtail - hdr.sb_cqhead > entries) {
+		return EINVAL;
+	}
+
+	n = hdr.sb_sqtail - hdr.sb_sqhead;
+	if (n > count) {
+		n = count;
+	}
+	if (n > entries - (hdr.sb_cqtail - hdr.sb_cqhead)) {
+		n = entries - (hdr.sb_cqtail - hdr.sb_cqhead);
+	}
+
+	result = 0;
+	lostcqe = false;
+	for (done = 0; done < n; done++) {
+		result = copyin((const_userptr_t)
+				&ur->sb_sqes[(hdr.sb_sqhead + done) & mask],
+				&sqe, sizeof(sqe));
+		if (result) {
+			break;
+		}
+		sysbatch_run(&sqe, &cqe);
+		result = copyout(&cqe, (userptr_t)
+				 &ucqes[(hdr.sb_cqtail + done) & mask],
+				 sizeof(cqe));
+		if (result) {
+			/*
+			 * The call has already run, so it must not be
+			 * picked up again; consume its submission even
+			 * though its completion never got out.
+			 */
+			lostcqe = true;
+			break;
+		}
+	}
+
+	consumed = lostcqe ? done + 1 : done;
+	hdr.sb_sqhead += consumed;
+	hdr.sb_cqtail += done;
+	result2 = copyout(&hdr.sb_sqhead, (userptr_t)&ur->sb_sqhead,
+			  sizeof(hdr.sb_sqhead));
+	if (result2 == 0) {
+		result2 = copyout(&hdr.sb_cqtail, (userptr_t)&ur->sb_cqtail,
+				  sizeof(hdr.sb_cqtail));
+	}
+	if (result2) {
+		return result2;
+	}
+	if (result && (done == 0 || lostcqe)) {
+		return result;
+	}
+
+	*retval = done;
+	return 0;
+}
@@ -0,0 +1,200 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscall.h>
+#include <lib.h>
+#include <spl.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
+#include <copyinout.h>
+#include <platform/maxcpus.h>
+#include <syscallstat.h>
+
+/*
+ * System call statistics.
+ *
+ * Each cpu has its own table, indexed by call number, which only it
+ * updates, with interrupts off so the update can't be interleaved with
+ * another on the same cpu. Readers sum the tables without locking; a
+ * count read mid-update may be off by one call.
+ */
+
+static struct syscallstat *syscallstat_cpus[MAXCPUS];
+
+/* Names for the report; calls not listed are shown by number. */
+static const char *const syscallstat_names[SYSCALLSTAT_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_getpid] = "getpid",
+	[SYS_sbrk] = "sbrk",
+	[SYS_mmap] = "mmap",
+	[SYS_munmap] = "munmap",
+	[SYS_open] = "open",
+	[SYS_dup2] = "dup2",
+	[SYS_close] = "close",
+	[SYS_pipe] = "pipe",
+	[SYS_read] = "read",
+	[SYS_pread] = "pread",
+	[SYS_readv] = "readv",
+	[SYS_write] = "write",
+	[SYS_pwrite] = "pwrite",
+	[SYS_writev] = "writev",
+	[SYS_lseek] = "lseek",
+	[SYS_chdir] = "chdir",
+	[SYS___getcwd] = "__getcwd",
+	[SYS_getrusage] = "getrusage",
+	[SYS___time] = "__time",
+	[SYS_nanosleep] = "nanosleep",
+	[SYS_reboot] = "reboot",
+	[SYS___threadcreate] = "__threadcreate",
+	[SYS_threadexit] = "threadexit",
+	[SYS___threadjoin] = "__threadjoin",
+	[SYS_futex_wait] = "futex_wait",
+	[SYS_futex_wake] = "futex_wake",
+	[SYS_sysbatch_setup] = "sysbatch_setup",
+	[SYS_sysbatch_enter] = "sysbatch_enter",
+	[SYS_spawn] = "spawn",
+	[SYS_syscallstat] = "syscallstat",
+	[SYS_copy_file_range] = "copy_file_range",
+	[SYS_getdirentries] = "getdirentries",
+};
+
+void
+syscallstat_cpuinit(unsigned cpunum)
+{
+	struct syscallstat *table;
+
+	KASSERT(cpunum < MAXCPUS);
+	table = kmalloc(SYSCALLSTAT_NCALLS * sizeof(*table));
+	if (table == NULL) {
+		panic("syscallstat: Out of memory\n");
+	}
+	bzero(table, SYSCALLSTAT_NCALLS * sizeof(*table));
+	syscallstat_cpus[cpunum] = table;
+}
+
+uint64_t
+syscallstat_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000ULL + nsecs;
+}
+
+void
+syscallstat_record(int callno, int err, uint64_t start)
+{
+	struct syscallstat *ss;
+	uint64_t now, ns;
+	unsigned b;
+	int spl;
+
+	if (callno < 0 || callno >= SYSCALLSTAT_NCALLS) {
+		return;
+	}
+
+	now = syscallstat_now();
+	ns = now > start ? now - start : 0;
+	for (b = 0; b < SYSCALLSTAT_BUCKETS - 1 && (ns >> (b + 1)) != 0; b++) {
+		/* nothing */
+	}
+
+	/* Stay on this cpu while updating its table */
+	spl = splhigh();
+	ss = &syscallstat_cpus[curcpu->c_number][callno];
+	ss->ss_calls++;
+	if (err) {
+		ss->ss_errors++;
+	}
+	ss->ss_nsecs += ns;
+	ss->ss_hist[b]++;
+	splx(spl);
+}
+
+/*
+ * Add up the cpus' counts for CALLNO.
+ */
+static
+void
+syscallstat_sum(int callno, struct syscallstat *total)
+{
+	struct syscallstat *ss;
+	unsigned i, b;
+
+	bzero(total, sizeof(*total));
+	for (i=0; i<MAXCPUS; i++) {
+		if (syscallstat_cpus[i] == NULL) {
+			continue;
+		}
+		ss = &syscallstat_cpus[i][callno];
+		total->ss_calls += ss->ss_calls;
+		total->ss_errors += ss->ss_errors;
+		total->ss_nsecs += ss->ss_nsecs;
+		for (b=0; b<SYSCALLSTAT_BUCKETS; b++) {
+			total->ss_hist[b] += ss->ss_hist[b];
+		}
+	}
+}
+
+void
+syscallstat_reset(void)
+{
+	unsigned i;
+
+	for (i=0; i<MAXCPUS; i++) {
+		if (syscallstat_cpus[i] != NULL) {
+			bzero(syscallstat_cpus[i],
+			      SYSCALLSTAT_NCALLS * sizeof(struct syscallstat));
+		}
+	}
+}
+
+void
+syscallstat_print(void)
+{
+	struct syscallstat ss;
+	char numbuf[16];
+	const char *name;
+	unsigned b;
+	int callno;
+
+	kprintf("%-16s %10s %8s %10s  %s\n", "call", "calls", "errors",
+		"avg(ns)", "log2(ns):calls");
+	for (callno=0; callno<SYSCALLSTAT_NCALLS; callno++) {
+		syscallstat_sum(callno, &ss);
+		if (ss.ss_calls == 0) {
+			continue;
+		}
+		name = syscallstat_names[callno];
+		if (name == NULL) {
+			snprintf(numbuf, sizeof(numbuf), "#%d", callno);
+			name = numbuf;
+		}
+		kprintf("%-16s %10llu %8llu %10llu ", name,
+			(unsigned long long)ss.ss_calls,
+			(unsigned long long)ss.ss_errors,
+			(unsigned long long)(ss.ss_nsecs / ss.ss_calls));
+		for (b=0; b<SYSCALLSTAT_BUCKETS; b++) {
+			if (ss.ss_hist[b] > 0) {
+				kprintf(" %u:%u", b, ss.ss_hist[b]);
+			}
+		}
+		kprintf("\n");
+	}
+}
+
+int
+sys_syscallstat(int callno, userptr_t stat)
+{
+	struct syscallstat ss;
+
+	if (callno < 0 || callno >= SYSCALLSTAT_NCALLS) {
+		return EINVAL;
+	}
+	syscallstat_sum(callno, &ss);
+	return copyout(&ss, stat, sizeof(ss));
+}
@@ -28,6 +28,8 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
@@ -56,3 +58,49 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * nanosleep: sleep for the interval in *REQ, rounded up to a whole
+ * number of hardclock ticks. We have no signals, so the sleep is
+ * never interrupted; if REM is given it's set to zero.
+ */
+int
+sys_nanosleep(userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec ts;
+	uint64_t nsecs, ticks;
+	int result;
+
+	result = copyin(user_req, &ts, sizeof(ts));
+	if (result) {
+		return result;
+	}
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	nsecs = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	ticks = (nsecs + (1000000000 / HZ) - 1) / (1000000000 / HZ);
+	while (ticks > 0) {
+		/* Keep each step well inside the wheel's 32-bit tick range */
+		if (ticks > 0x40000000) {
+			clocksleep_ticks(0x40000000);
+			ticks -= 0x40000000;
+		}
+		else {
+			clocksleep_ticks(ticks);
+			ticks = 0;
+		}
+	}
+
+	if (user_rem != NULL) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+		result = copyout(&ts, user_rem, sizeof(ts));
+		if (result) {
+			return result;
+		}
+	}
+
+	return 0;
+}
@@ -41,6 +41,7 @@
 #define NSEMLOOPS     63
 #define NLOCKLOOPS    120
 #define NCVLOOPS      5
+#define NRWLOOPS      60
 #define NTHREADS      32
 
 static volatile unsigned long testval1;
@@ -49,6 +50,7 @@ static volatile unsigned long testval3;
 static struct semaphore *testsem;
 static struct lock *testlock;
 static struct cv *testcv;
+static struct rwlock *testrw;
 static struct semaphore *donesem;
 
 static
@@ -73,6 +75,12 @@ inititems(void)
 			panic("synchtest: cv_create failed\n");
 		}
 	}
+	if (testrw==NULL) {
+		testrw = rwlock_create("testrw");
+		if (testrw == NULL) {
+			panic("synchtest: rwlock_create failed\n");
+		}
+	}
 	if (donesem==NULL) {
 		donesem = sem_create("donesem", 0);
 		if (donesem == NULL) {
@@ -357,3 +365,122 @@ cvtest2(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Reader-writer lock test. Every fourth thread is a writer; writers
+ * set the test values in a pattern and readers check it. A writer
+ * also counts itself in testval3 while it holds the lock, so a reader
+ * or writer that ever sees anyone else inside with a writer knows
+ * the lock let it in wrongly.
+ */
+
+static volatile unsigned rwreaders;	/* readers inside right now */
+static volatile unsigned rwmaxreaders;	/* most seen at once */
+static struct spinlock rwcountlock = SPINLOCK_INITIALIZER;
+
+static
+void
+rwfail(unsigned long num, const char *msg, bool writer)
+{
+	kprintf("thread %lu: Mismatch on %s\n", num, msg);
+	kprintf("Test failed\n");
+
+	if (writer) {
+		rwlock_release_write(testrw);
+	}
+	else {
+		rwlock_release_read(testrw);
+	}
+
+	V(donesem);
+	thread_exit();
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num % 4 == 0) {
+			rwlock_acquire_write(testrw);
+			if (testval3 != 0 || rwreaders != 0) {
+				rwfail(num, "writer entry", true);
+			}
+			testval3 = 1;
+			testval1 = num;
+			for (j=0; j<100; j++);
+			testval2 = num*num;
+			if (testval1 != num || testval3 != 1) {
+				rwfail(num, "testval1/num", true);
+			}
+			testval3 = 0;
+			rwlock_release_write(testrw);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+			spinlock_acquire(&rwcountlock);
+			rwreaders++;
+			if (rwreaders > rwmaxreaders) {
+				rwmaxreaders = rwreaders;
+			}
+			spinlock_release(&rwcountlock);
+
+			if (testval3 != 0) {
+				rwfail(num, "reader entry", false);
+			}
+			if (testval2 != testval1*testval1) {
+				rwfail(num, "testval2/testval1", false);
+			}
+			for (j=0; j<100; j++);
+			if (testval2 != testval1*testval1) {
+				rwfail(num, "testval2/testval1", false);
+			}
+
+			spinlock_acquire(&rwcountlock);
+			rwreaders--;
+			spinlock_release(&rwcountlock);
+			rwlock_release_read(testrw);
+		}
+		thread_yield();
+	}
+	V(donesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting rwlock test...\n");
+
+	testval1 = 0;
+	testval2 = 0;
+	testval3 = 0;
+	rwreaders = 0;
+	rwmaxreaders = 0;
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("synchtest", rwtestthread, NULL, i,
+				     NULL);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	kprintf("Most readers at once: %u\n", rwmaxreaders);
+	kprintf("RW lock test done.\n");
+
+	return 0;
+}
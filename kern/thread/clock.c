@@ -30,17 +30,25 @@
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
+#include <mainbus.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <timeout.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Callbacks at specific points in the future are scheduled with the
+ * timer wheel in timeout.c, which has a resolution of one tick (1/HZ
+ * seconds). It's run from timerclock(), which the timer device calls
+ * when the countdown set through timerclock_set() runs out.
+ *
+ * hardclock() is only for scheduling and accounting. Idle cpus stop
+ * taking it (see hardclock_idle) when there's no work waiting anywhere,
+ * and running threads are preempted only when their time slice is used
+ * up.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -51,12 +59,29 @@
  * the scheduler.
  */
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
-#define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Decay factors for the 1, 5, and 15 minute load averages, sampled
+ * every 5 seconds: exp(-5/60), exp(-5/300), exp(-5/900), scaled by
+ * LOADAVG_FSCALE.
+ */
+static const unsigned loadavg_cexp[3] = {
+	1884,	/* 0.9200 */
+	2014,	/* 0.9835 */
+	2037,	/* 0.9945 */
+};
+
+/*
+ * The timer device that calls timerclock(), if one has attached.
  */
-static struct wchan *lbolt;
+static void *timerclock_devdata;
+static void (*timerclock_settimer)(void *devdata, uint32_t usecs);
+
+/*
+ * Threads in clocksleep wait here. Nobody ever wakes this channel;
+ * sleepers leave it only when their timeout expires.
+ */
+static struct wchan *sleepchan;
 
 /*
  * Setup.
@@ -64,42 +89,186 @@ static struct wchan *lbolt;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	sleepchan = wchan_create("clocksleep");
+	if (sleepchan == NULL) {
+		panic("Couldn't create clocksleep wchan\n");
+	}
+	timeout_bootstrap();
+}
+
+/*
+ * Called by the timer device driver when it attaches. SETTIMER(DEVDATA,
+ * USECS) should make the device call timerclock() once, USECS
+ * microseconds from now, replacing any countdown already running.
+ *
+ * Until the timer wheel first runs it has nothing to program the
+ * device with, so start it off with a one-second countdown.
+ */
+void
+timerclock_attach(void *devdata, void (*settimer)(void *, uint32_t))
+{
+	KASSERT(timerclock_settimer == NULL);
+	timerclock_devdata = devdata;
+	timerclock_settimer = settimer;
+	settimer(devdata, 1000000);
+}
+
+/*
+ * Start the timer device's countdown. Returns false if there is no
+ * timer device, in which case the timer wheel is run from hardclock.
+ */
+bool
+timerclock_set(uint32_t usecs)
+{
+	if (timerclock_settimer == NULL) {
+		return false;
 	}
+	timerclock_settimer(timerclock_devdata, usecs);
+	return true;
 }
 
 /*
- * This is called once per second, on one processor, by the timer
- * code.
+ * This is called on one processor by the timer device when its
+ * countdown runs out.
  */
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	wchan_wakeall(lbolt);
+	timeout_run();
+}
+
+/*
+ * Fold the current cpu's instantaneous load (threads running plus
+ * threads waiting to run) into its load averages.
+ */
+static
+void
+loadavg_update(void)
+{
+	unsigned nrun, i;
+
+	nrun = curcpu->c_runqueue.tl_count + (curcpu->c_isidle ? 0 : 1);
+	for (i=0; i<3; i++) {
+		curcpu->c_loadavg[i] =
+			(curcpu->c_loadavg[i] * loadavg_cexp[i] +
+			 nrun * LOADAVG_FSCALE *
+			 (LOADAVG_FSCALE - loadavg_cexp[i])) >> LOADAVG_FSHIFT;
+	}
 }
 
 /*
  * This is called HZ times a second (on each processor) by the timer
- * code.
+ * code, except on idle processors, which stop their tick.
  */
 void
 hardclock(void)
 {
 	/*
-	 * Collect statistics here as desired.
+	 * Charge this tick to the idle loop or to the running thread.
 	 */
+	if (curcpu->c_isidle) {
+		curcpu->c_idleclocks++;
+	}
+	else {
+		curcpu->c_busyclocks++;
+		if (curthread->t_intr_from_user) {
+			curthread->t_usage.tu_uclocks++;
+		}
+		else {
+			curthread->t_usage.tu_sclocks++;
+		}
+	}
 
 	curcpu->c_hardclocks++;
+
+	/* Without a timer device the boot cpu runs the timer wheel. */
+	if (timerclock_settimer == NULL && curcpu->c_number == 0) {
+		timeout_run();
+	}
+
+	if ((curcpu->c_hardclocks % LOADAVG_HARDCLOCKS) == 0) {
+		loadavg_update();
+	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
-		thread_consider_migration();
+
+	/*
+	 * Preempt the current thread only once its slice is used up.
+	 * (thread_switch hands out a new slice whenever it picks a
+	 * thread to run; if nothing else is runnable thread_yield
+	 * returns right away and we just carry on with a fresh one.)
+	 */
+	if (!curcpu->c_isidle) {
+		if (curcpu->c_slice <= 1) {
+			curcpu->c_slice = SLICE_HARDCLOCKS;
+			thread_yield();
+		}
+		else {
+			curcpu->c_slice--;
+		}
+	}
+}
+
+/*
+ * Account for TICKS hardclocks that the current cpu slept through
+ * with its tick stopped. Called by the MD timer code.
+ */
+void
+hardclock_catchup(unsigned ticks)
+{
+	unsigned before, n;
+
+	before = curcpu->c_hardclocks;
+	curcpu->c_hardclocks += ticks;
+	curcpu->c_idleclocks += ticks;
+
+	/* Idle the whole time, so each missed load sample was 0 */
+	n = curcpu->c_hardclocks / LOADAVG_HARDCLOCKS -
+		before / LOADAVG_HARDCLOCKS;
+	while (n-- > 0) {
+		loadavg_update();
+	}
+}
+
+/*
+ * Idle the current cpu until something happens, with its periodic
+ * hardclock stopped. Called from the idle loop with interrupts off.
+ * Whatever wakes the cpu up (an IPI because there's work for it, or
+ * a device interrupt) also restarts the tick, and the ticks that
+ * were skipped are passed to hardclock_catchup.
+ *
+ * The one exception is the boot cpu when there's no timer device,
+ * since then its hardclock drives the timer wheel.
+ */
+void
+hardclock_idle(void)
+{
+	bool tickless;
+
+	tickless = timerclock_settimer != NULL || curcpu->c_number != 0;
+	if (tickless) {
+		mainbus_timer_stop();
+	}
+	cpu_idle();
+	if (tickless) {
+		mainbus_timer_restart();
+	}
+}
+
+/*
+ * Suspend execution for at least the given number of hardclock ticks.
+ */
+void
+clocksleep_ticks(unsigned ticks)
+{
+	uint32_t deadline, now;
+
+	deadline = timeout_ticks() + ticks;
+	while ((int32_t)(deadline - (now = timeout_ticks())) > 0) {
+		wchan_lock(sleepchan);
+		wchan_sleep_timeout(sleepchan, deadline - now);
 	}
-	thread_yield();
 }
 
 /*
@@ -108,9 +277,7 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-	while (num_secs > 0) {
-		wchan_lock(lbolt);
-		wchan_sleep(lbolt);
-		num_secs--;
+	if (num_secs > 0) {
+		clocksleep_ticks((unsigned)num_secs * HZ);
 	}
 }
@@ -0,0 +1,235 @@
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <lockstat.h>
+
+/*
+ * Lock contention statistics.
+ *
+ * The records live in a fixed table, since the first locks are set up
+ * long before kmalloc works. The locks here are bare test-and-set
+ * words rather than spinlocks, because spinlocks are what's being
+ * counted. tablelock covers adding records; each record's ls_lock
+ * covers its counts, which are updated by every lock of that name.
+ */
+
+#define LOCKSTAT_MAX		256
+#define LOCKSTAT_NAMELEN	24
+
+/* Table slots for names that didn't fit */
+#define LOCKSTAT_OTHER_SPIN	0
+#define LOCKSTAT_OTHER_SLEEP	1
+
+struct lockstat {
+	volatile spinlock_data_t ls_lock;
+	char ls_name[LOCKSTAT_NAMELEN];
+	bool ls_spin;			/* spinlock, not sleep lock */
+	uint64_t ls_acquires;		/* times acquired */
+	uint64_t ls_contended;		/* times it had to wait */
+	uint64_t ls_waittime;		/* total ns waited */
+	uint64_t ls_maxwait;		/* longest wait */
+	uint64_t ls_holdtime;		/* total ns held */
+	uint64_t ls_maxhold;		/* longest hold */
+};
+
+static volatile spinlock_data_t tablelock = SPINLOCK_DATA_INITIALIZER;
+static struct lockstat lockstat_table[LOCKSTAT_MAX] = {
+	[LOCKSTAT_OTHER_SPIN] = { .ls_name = "(other)", .ls_spin = true },
+	[LOCKSTAT_OTHER_SLEEP] = { .ls_name = "(other)", .ls_spin = false },
+};
+static unsigned lockstat_count = 2;
+static volatile bool lockstat_on;
+
+static
+void
+word_lock(volatile spinlock_data_t *word)
+{
+	while (spinlock_data_get(word) != 0 ||
+	       spinlock_data_testandset(word) != 0) {
+		/* spin */
+	}
+}
+
+static
+void
+word_unlock(volatile spinlock_data_t *word)
+{
+	spinlock_data_set(word, 0);
+}
+
+uint64_t
+lockstat_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (!lockstat_on) {
+		return 0;
+	}
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000ULL + nsecs;
+}
+
+struct lockstat *
+lockstat_lookup(const char *name, bool spin)
+{
+	struct lockstat *ls;
+	char key[LOCKSTAT_NAMELEN];
+	unsigned i;
+	int spl;
+
+	if (name == NULL) {
+		name = "(unnamed)";
+	}
+
+	/* Names are kept truncated to fit */
+	for (i=0; i<LOCKSTAT_NAMELEN-1 && name[i] != 0; i++) {
+		key[i] = name[i];
+	}
+	key[i] = 0;
+
+	spl = splhigh();
+	word_lock(&tablelock);
+	for (i=0; i<lockstat_count; i++) {
+		ls = &lockstat_table[i];
+		if (ls->ls_spin == spin && !strcmp(ls->ls_name, key)) {
+			goto done;
+		}
+	}
+	if (lockstat_count < LOCKSTAT_MAX) {
+		ls = &lockstat_table[lockstat_count++];
+		strcpy(ls->ls_name, key);
+		ls->ls_spin = spin;
+	}
+	else {
+		ls = &lockstat_table[spin ? LOCKSTAT_OTHER_SPIN :
+				     LOCKSTAT_OTHER_SLEEP];
+	}
+ done:
+	word_unlock(&tablelock);
+	splx(spl);
+	return ls;
+}
+
+void
+lockstat_acquire(struct lockstat *ls, bool contended,
+		 uint64_t waitstart, uint64_t now)
+{
+	uint64_t wait;
+
+	word_lock(&ls->ls_lock);
+	ls->ls_acquires++;
+	if (contended) {
+		ls->ls_contended++;
+		if (waitstart != 0 && now > waitstart) {
+			wait = now - waitstart;
+			ls->ls_waittime += wait;
+			if (wait > ls->ls_maxwait) {
+				ls->ls_maxwait = wait;
+			}
+		}
+	}
+	word_unlock(&ls->ls_lock);
+}
+
+void
+lockstat_release(struct lockstat *ls, uint64_t acqtime, uint64_t now)
+{
+	uint64_t hold;
+
+	if (acqtime == 0 || now <= acqtime) {
+		return;
+	}
+	hold = now - acqtime;
+
+	word_lock(&ls->ls_lock);
+	ls->ls_holdtime += hold;
+	if (hold > ls->ls_maxhold) {
+		ls->ls_maxhold = hold;
+	}
+	word_unlock(&ls->ls_lock);
+}
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_on = true;
+}
+
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+	unsigned i;
+	int spl;
+
+	spl = splhigh();
+	for (i=0; i<lockstat_count; i++) {
+		ls = &lockstat_table[i];
+		word_lock(&ls->ls_lock);
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_waittime = 0;
+		ls->ls_maxwait = 0;
+		ls->ls_holdtime = 0;
+		ls->ls_maxhold = 0;
+		word_unlock(&ls->ls_lock);
+	}
+	splx(spl);
+}
+
+void
+lockstat_print(void)
+{
+	struct lockstat *copy, tmp;
+	unsigned i, j, n;
+	int spl;
+
+	/* Copy the records so kmalloc and kprintf don't skew them. */
+	copy = kmalloc(LOCKSTAT_MAX * sizeof(*copy));
+	if (copy == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+
+	spl = splhigh();
+	n = 0;
+	for (i=0; i<lockstat_count; i++) {
+		word_lock(&lockstat_table[i].ls_lock);
+		if (lockstat_table[i].ls_acquires > 0) {
+			copy[n++] = lockstat_table[i];
+		}
+		word_unlock(&lockstat_table[i].ls_lock);
+	}
+	splx(spl);
+
+	/* Insertion sort, most total wait first */
+	for (i=1; i<n; i++) {
+		tmp = copy[i];
+		for (j=i; j>0 && copy[j-1].ls_waittime < tmp.ls_waittime; j--) {
+			copy[j] = copy[j-1];
+		}
+		copy[j] = tmp;
+	}
+
+	kprintf("%-23s %-5s %10s %9s %11s %9s %11s %9s\n",
+		"lock", "kind", "acquires", "contended", "wait(us)",
+		"maxwait", "hold(us)", "maxhold");
+	for (i=0; i<n; i++) {
+		kprintf("%-23s %-5s %10llu %9llu %11llu %9llu %11llu %9llu\n",
+			copy[i].ls_name, copy[i].ls_spin ? "spin" : "sleep",
+			(unsigned long long)copy[i].ls_acquires,
+			(unsigned long long)copy[i].ls_contended,
+			(unsigned long long)(copy[i].ls_waittime / 1000),
+			(unsigned long long)(copy[i].ls_maxwait / 1000),
+			(unsigned long long)(copy[i].ls_holdtime / 1000),
+			(unsigned long long)(copy[i].ls_maxhold / 1000));
+	}
+	if (!lockstat_on) {
+		kprintf("(not collecting yet)\n");
+	}
+
+	kfree(copy);
+}
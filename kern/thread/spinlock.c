@@ -36,6 +36,7 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -50,6 +51,26 @@ spinlock_init(struct spinlock *lk)
 {
 	spinlock_data_set(&lk->lk_lock, 0);
 	lk->lk_holder = NULL;
+#if OPT_LOCKSTAT
+	lk->lk_name = NULL;
+	lk->lk_stat = NULL;
+	lk->lk_acqtime = 0;
+#endif
+}
+
+/*
+ * Name the lock for lock statistics.
+ */
+void
+spinlock_setname(struct spinlock *lk, const char *name)
+{
+#if OPT_LOCKSTAT
+	lk->lk_name = NULL;
+	lk->lk_stat = lockstat_lookup(name, true);
+#else
+	(void)lk;
+	(void)name;
+#endif
 }
 
 /*
@@ -73,6 +94,10 @@ void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+#if OPT_LOCKSTAT
+	bool contended = false;
+	uint64_t waitstart = 0, now;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -98,16 +123,31 @@ spinlock_acquire(struct spinlock *lk)
 		 * previously unheld and we now own it. If it was 1,
 		 * we don't.
 		 */
-		if (spinlock_data_get(&lk->lk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
+		if (spinlock_data_get(&lk->lk_lock) != 0 ||
+		    spinlock_data_testandset(&lk->lk_lock) != 0) {
+#if OPT_LOCKSTAT
+			if (!contended) {
+				contended = true;
+				waitstart = lockstat_now();
+			}
+#endif
 			continue;
 		}
 		break;
 	}
 
 	lk->lk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	now = lockstat_now();
+	if (now != 0) {
+		if (lk->lk_stat == NULL) {
+			lk->lk_stat = lockstat_lookup(lk->lk_name, true);
+		}
+		lockstat_acquire(lk->lk_stat, contended, waitstart, now);
+	}
+	lk->lk_acqtime = now;
+#endif
 }
 
 /*
@@ -121,6 +161,12 @@ spinlock_release(struct spinlock *lk)
 		KASSERT(lk->lk_holder == curcpu->c_self);
 	}
 
+#if OPT_LOCKSTAT
+	if (lk->lk_acqtime != 0) {
+		lockstat_release(lk->lk_stat, lk->lk_acqtime, lockstat_now());
+	}
+#endif
+
 	lk->lk_holder = NULL;
 	spinlock_data_set(&lk->lk_lock, 0);
 	spllower(IPL_HIGH, IPL_NONE);
@@ -39,6 +39,7 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 
 
 ////////////////////////////////////////////////////////////
@@ -71,6 +72,7 @@ sem_create(const char *name, int initial_count)
 	}
 
 	spinlock_init(&sem->sem_lock);
+	spinlock_setname(&sem->sem_lock, sem->sem_name);
         sem->sem_count = initial_count;
 
         return sem;
@@ -174,8 +176,14 @@ lock_create(const char *name)
         		return NULL;
         	}
         spinlock_init(&lock->lk_spinlock);
+        spinlock_setname(&lock->lk_spinlock, lock->lk_name);
         lock->lock_hold=0;
         lock->lk_thread= NULL;
+        lock->lk_waiters = 0;
+#if OPT_LOCKSTAT
+        lock->lk_stat = lockstat_lookup(lock->lk_name, false);
+        lock->lk_acqtime = 0;
+#endif
 
        /* DEBUG(DB_THREADS,
         				"Exiting lock_create");*/
@@ -186,6 +194,7 @@ void
 lock_destroy(struct lock *lock)
 {
         KASSERT(lock != NULL);
+        KASSERT(lock->lk_waiters == 0);
 
         // add stuff here as needed
         wchan_destroy(lock->lock_wchan);
@@ -194,64 +203,114 @@ lock_destroy(struct lock *lock)
         kfree(lock);
 }
 
+/*
+ * How many times to poll the lock while its holder is running
+ * elsewhere before checking again that the holder is still running.
+ */
+#define LOCK_SPIN_CHECK 200
+
+/*
+ * Return true if it's worth spinning for LOCK: its holder is running
+ * on another cpu. Must hold lk_spinlock, which keeps the holder from
+ * letting go of the lock (and so from exiting) while we look at it.
+ */
+static
+bool
+lock_holder_running(struct lock *lock)
+{
+	struct thread *holder;
+
+	holder = lock->lk_thread;
+	if (holder == NULL || !CURCPU_EXISTS()) {
+		return false;
+	}
+	return holder->t_state == S_RUN && holder->t_cpu != curcpu;
+}
+
 void
 lock_acquire(struct lock *lock)
 {
-        // Write this
-	/*DEBUG(DB_THREADS,
-	        				"Inside lock_acquire");*/
-	struct thread *mythread;
+	unsigned i;
+#if OPT_LOCKSTAT
+	bool contended = false;
+	uint64_t waitstart = 0, now;
+#endif
+
 	KASSERT(lock != NULL);
-    //KASSERT(curthread->t_in_interrupt == false);
+	//KASSERT(curthread->t_in_interrupt == false);
 
 	spinlock_acquire(&lock->lk_spinlock);
+	KASSERT(!CURCPU_EXISTS() || lock->lk_thread != curthread ||
+		lock->lock_hold == 0);
+
+	while (lock->lock_hold == 1) {
+#if OPT_LOCKSTAT
+		if (!contended) {
+			contended = true;
+			waitstart = lockstat_now();
+		}
+#endif
+		if (lock_holder_running(lock)) {
+			spinlock_release(&lock->lk_spinlock);
+			for (i=0; i<LOCK_SPIN_CHECK && lock->lock_hold; i++) {
+				/* nothing */
+			}
+			spinlock_acquire(&lock->lk_spinlock);
+			continue;
+		}
 
-	while(lock->lock_hold==1){
+		/*
+		 * Sleep. lock_release hands us the lock before waking
+		 * us, so once we're back it's ours.
+		 */
+		lock->lk_waiters++;
 		wchan_lock(lock->lock_wchan);
 		spinlock_release(&lock->lk_spinlock);
 		wchan_sleep(lock->lock_wchan);
 		spinlock_acquire(&lock->lk_spinlock);
+		KASSERT(lock->lock_hold == 1 && lock->lk_thread == NULL);
+		break;
 	}
-/*	else if(lock->lock_hold==0){
-		if (CURCPU_EXISTS()) {
-				mythread = curthread;
-				if (lock->lk_thread == mythread) {
-					panic("Deadlock on thread %p\n", lock);
-				}
-			}
-			else {
-				mythread = NULL;
-			} */
 
-	if(curthread!= NULL){
-				 mythread = curthread;
-				 lock->lk_thread = mythread;
+	lock->lock_hold = 1;
+	lock->lk_thread = CURCPU_EXISTS() ? curthread : NULL;
+
+#if OPT_LOCKSTAT
+	now = lockstat_now();
+	if (now != 0) {
+		lockstat_acquire(lock->lk_stat, contended, waitstart, now);
 	}
-	lock->lock_hold= 1;
+	lock->lk_acqtime = now;
+#endif
 
 	spinlock_release(&lock->lk_spinlock);
-
-	  //KASSERT(lock->lock_count > 0);
-
-       //(void)lock;  // suppress warning until code gets written
-	/*DEBUG(DB_THREADS,
-	        				"Exiting lock_acquire");*/
 }
 
 void
 lock_release(struct lock *lock)
 {
-        // Write this
-    KASSERT(lock != NULL);
-    spinlock_acquire(&lock->lk_spinlock);
+	KASSERT(lock != NULL);
+	spinlock_acquire(&lock->lk_spinlock);
+
+#if OPT_LOCKSTAT
+	if (lock->lk_acqtime != 0) {
+		lockstat_release(lock->lk_stat, lock->lk_acqtime,
+				 lockstat_now());
+		lock->lk_acqtime = 0;
+	}
+#endif
 
-    lock->lock_hold=0;
-    KASSERT(lock->lock_hold== 0);
-    lock->lk_thread= NULL;
-    wchan_wakeone(lock->lock_wchan);
+	lock->lk_thread = NULL;
+	if (lock->lk_waiters > 0) {
+		/* Leave it held; it now belongs to the thread we wake. */
+		lock->lk_waiters--;
+		wchan_wakeone(lock->lock_wchan);
+	}
+	else {
+		lock->lock_hold = 0;
+	}
 
-    spinlock_release(&lock->lk_spinlock);
-       // (void)lock;  // suppress warning until code gets written
+	spinlock_release(&lock->lk_spinlock);
 }
 
 bool
@@ -347,6 +406,26 @@ cv_wait(struct cv *cv, struct lock *lock)
         }
 }
 
+/*
+ * cv_wait with a timeout of TICKS hardclocks. Returns 0 if signalled
+ * and ETIMEDOUT if the time ran out; the lock is held again on return
+ * either way.
+ */
+int
+cv_wait_timeout(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+	int result;
+
+	KASSERT(lock_do_i_hold(lock));
+
+	wchan_lock(cv->cv_wchan);
+	lock_release(lock);
+	result = wchan_sleep_timeout(cv->cv_wchan, ticks);
+	lock_acquire(lock);
+
+	return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -378,98 +457,179 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 //RW Locks
 
 
+/*
+ * Owner recorded for a writer that has been handed the lock but has
+ * not run yet.
+ */
+#define RWLOCK_HANDOFF ((struct thread *)1)
+
 struct rwlock *
 rwlock_create(const char *name)
 {
 	struct rwlock *rw;
 
-	rw = kmalloc(sizeof(rw));
-	if(rw==NULL){
+	rw = kmalloc(sizeof(*rw));
+	if (rw == NULL) {
 		return NULL;
 	}
 
-	rw->rwlock_name=kstrdup(name);
-	if(rw->rwlock_name==NULL){
+	rw->rwlock_name = kstrdup(name);
+	if (rw->rwlock_name == NULL) {
 		kfree(rw);
 		return NULL;
 	}
 
-
-	//Create Semaphore
-	rw->rwlock_semaphore = sem_create(rw->rwlock_name,MAX_READ);
-	if (rw->rwlock_semaphore == NULL) {
-			kfree(rw->rwlock_name);
-			kfree(rw);
-			return NULL;
+	rw->rwlock_rwchan = wchan_create(rw->rwlock_name);
+	if (rw->rwlock_rwchan == NULL) {
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
 	}
-	//rw->read_count=0;
-	//Create Lock
-	rw->rwlock_lock=lock_create(rw->rwlock_name);
-   	if (rw->rwlock_lock == NULL) {
-   		kfree(rw->rwlock_name);
-   		kfree(rw);
-	    return NULL;
+
+	rw->rwlock_wwchan = wchan_create(rw->rwlock_name);
+	if (rw->rwlock_wwchan == NULL) {
+		wchan_destroy(rw->rwlock_rwchan);
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
 	}
 
+	spinlock_init(&rw->rwlock_lock);
+	spinlock_setname(&rw->rwlock_lock, rw->rwlock_name);
+	rw->rwlock_readers = 0;
+	rw->rwlock_rwaiting = 0;
+	rw->rwlock_wwaiting = 0;
+	rw->rwlock_writer = NULL;
+
 	return rw;
 }
 
 void
-rwlock_destroy(struct rwlock *rw_lock)
+rwlock_destroy(struct rwlock *rw)
 {
-	KASSERT(rw_lock != NULL);
-
-	        // add stuff here as needed
-		sem_destroy(rw_lock->rwlock_semaphore);
-		lock_destroy(rw_lock->rwlock_lock);
-	    kfree(rw_lock->rwlock_name);
-	    kfree(rw_lock);
+	KASSERT(rw != NULL);
+	KASSERT(rw->rwlock_readers == 0);
+	KASSERT(rw->rwlock_writer == NULL);
+	KASSERT(rw->rwlock_rwaiting == 0 && rw->rwlock_wwaiting == 0);
+
+	spinlock_cleanup(&rw->rwlock_lock);
+	wchan_destroy(rw->rwlock_wwchan);
+	wchan_destroy(rw->rwlock_rwchan);
+	kfree(rw->rwlock_name);
+	kfree(rw);
 }
+
+/*
+ * Hand the lock to whoever should have it next, after it's become
+ * free. Readers that were waiting go first if PREFER_READERS (a
+ * writer just finished); otherwise a waiting writer does. Called with
+ * the spinlock held.
+ */
+static
 void
-rwlock_acquire_read(struct rwlock *rw_lock)
+rwlock_handoff(struct rwlock *rw, bool prefer_readers)
 {
-	lock_acquire(rw_lock->rwlock_lock);
-
-	P(rw_lock->rwlock_semaphore);
-	//rw_lock->read_count++;
+	KASSERT(rw->rwlock_readers == 0 && rw->rwlock_writer == NULL);
 
-	lock_release(rw_lock->rwlock_lock);
+	if (rw->rwlock_rwaiting > 0 &&
+	    (prefer_readers || rw->rwlock_wwaiting == 0)) {
+		rw->rwlock_readers = rw->rwlock_rwaiting;
+		rw->rwlock_rwaiting = 0;
+		wchan_wakeall(rw->rwlock_rwchan);
+	}
+	else if (rw->rwlock_wwaiting > 0) {
+		/*
+		 * Any waiting writer will do. It finds itself the
+		 * owner when it wakes up, so mark the lock as taken
+		 * by a writer; it fills in its own thread pointer.
+		 */
+		rw->rwlock_wwaiting--;
+		rw->rwlock_writer = RWLOCK_HANDOFF;
+		wchan_wakeone(rw->rwlock_wwchan);
+	}
 }
 
 void
-rwlock_release_read(struct rwlock *rw_lock){
+rwlock_acquire_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rwlock_lock);
+	KASSERT(rw->rwlock_writer != curthread);
+	if (rw->rwlock_writer == NULL && rw->rwlock_wwaiting == 0) {
+		rw->rwlock_readers++;
+		spinlock_release(&rw->rwlock_lock);
+		return;
+	}
 
-	V(rw_lock->rwlock_semaphore);
-	//rw_lock->read_count--;
+	/*
+	 * Wait. Whoever wakes us has already counted us in
+	 * rwlock_readers. Bridge to the wchan lock as in P().
+	 */
+	rw->rwlock_rwaiting++;
+	wchan_lock(rw->rwlock_rwchan);
+	spinlock_release(&rw->rwlock_lock);
+	wchan_sleep(rw->rwlock_rwchan);
+
+	KASSERT(rw->rwlock_readers > 0);
 }
 
 void
-rwlock_acquire_write(struct rwlock *rw_lock){
-
-	lock_acquire(rw_lock->rwlock_lock);
+rwlock_release_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
 
-	while(1)
-	{
-		if(rw_lock->rwlock_semaphore->sem_count!=MAX_READ)
-			continue;
-		else if(rw_lock->rwlock_semaphore->sem_count==MAX_READ)
-		{
-			rw_lock->rwlock_semaphore->sem_count=1;
-			P(rw_lock->rwlock_semaphore);
-			break;
-		}
+	spinlock_acquire(&rw->rwlock_lock);
+	KASSERT(rw->rwlock_readers > 0);
+	rw->rwlock_readers--;
+	if (rw->rwlock_readers == 0) {
+		rwlock_handoff(rw, false);
 	}
-
-	lock_release(rw_lock->rwlock_lock);
+	spinlock_release(&rw->rwlock_lock);
 }
 
 void
-rwlock_release_write(struct rwlock *rw_lock){
+rwlock_acquire_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rwlock_lock);
+	KASSERT(rw->rwlock_writer != curthread);
+	if (rw->rwlock_writer == NULL && rw->rwlock_readers == 0) {
+		rw->rwlock_writer = curthread;
+		spinlock_release(&rw->rwlock_lock);
+		return;
+	}
 
-	rw_lock->rwlock_semaphore->sem_count=MAX_READ-1;
-	V(rw_lock->rwlock_semaphore);
+	rw->rwlock_wwaiting++;
+	wchan_lock(rw->rwlock_wwchan);
+	spinlock_release(&rw->rwlock_lock);
+	wchan_sleep(rw->rwlock_wwchan);
+
+	/* rwlock_handoff gave it to us */
+	spinlock_acquire(&rw->rwlock_lock);
+	KASSERT(rw->rwlock_writer == RWLOCK_HANDOFF);
+	KASSERT(rw->rwlock_readers == 0);
+	rw->rwlock_writer = curthread;
+	spinlock_release(&rw->rwlock_lock);
+}
 
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
 
+	spinlock_acquire(&rw->rwlock_lock);
+	KASSERT(rw->rwlock_writer == curthread);
+	rw->rwlock_writer = NULL;
+	rwlock_handoff(rw, true);
+	spinlock_release(&rw->rwlock_lock);
 }
 
-
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	return rw->rwlock_writer == curthread;
+}
@@ -47,14 +47,16 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <clock.h>
+#include <timeout.h>
 /* Added for file table size*/
 
 /**
  * Author: Pratham Malik
  */
 #include <psyscall.h>
-struct process_control *process_array[PROCESS_MAX];
-struct lock *pid_lock;
+#include <fdtable.h>
+#include <syscallstat.h>
 
 //End of Additions by PM
 
@@ -69,15 +71,23 @@ struct lock *pid_lock;
 //#include <psyscall.h>
 #include <limits.h>
 
-extern struct process_control *process_array[PROCESS_MAX];
-struct lock *pid_lock;
-
 //End of adding by Pratham Malik
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * A thread that last ran on its cpu fewer than this many hardclocks
+ * ago is assumed to still have a useful working set in that cpu's
+ * cache. Such threads are left where they are when woken up and are
+ * the last choice when stealing work.
+ */
+#define CACHE_HOT_HARDCLOCKS	2
+
+/* Smallest buffer allocated for a thread name; see thread_setname. */
+#define THREAD_NAME_MIN		32
+
 /* Wait channel. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -93,6 +103,11 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+static bool thread_steal(void);
+static void thread_wakeup_place(struct thread *target);
+static bool thread_work_elsewhere(void);
+static void thread_kick_idle(struct cpu *busy);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -135,39 +150,90 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Give THREAD the name NAME. Name buffers are never smaller than
+ * THREAD_NAME_MIN, so a recycled thread can usually just copy its new
+ * name over the old one.
  */
 static
-struct thread *
-thread_create(const char *name)
+int
+thread_setname(struct thread *thread, const char *name)
 {
-	struct thread *thread;
+	size_t len;
+	char *newname;
 
-	DEBUGASSERT(name != NULL);
+	len = strlen(name) + 1;
+	if (thread->t_name != NULL && len <= THREAD_NAME_MIN) {
+		strcpy(thread->t_name, name);
+		return 0;
+	}
 
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
+	newname = kmalloc(len > THREAD_NAME_MIN ? len : THREAD_NAME_MIN);
+	if (newname == NULL) {
+		return ENOMEM;
+	}
+	strcpy(newname, name);
+	if (thread->t_name != NULL) {
+		kfree(thread->t_name);
 	}
+	thread->t_name = newname;
+	return 0;
+}
 
-	thread->t_name = kstrdup(name);
-	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
+/*
+ * Set up the fields of a new or recycled thread, apart from its name
+ * and stack. If SIBLING, it joins the current thread's process;
+ * otherwise it gets a pid and file table of its own. On failure
+ * THREAD is left untouched.
+ */
+static
+int
+thread_init(struct thread *thread, bool sibling)
+{
+	struct fdtable *table;
+	pid_t processid;
+	int tid, result;
+
+	if (sibling) {
+		processid = curthread->t_pid;
+		result = proc_thread_add(processid, thread, &tid);
+		if (result) {
+			return result;
+		}
+		table = curthread->file_table;
+	}
+	else {
+		table = fdtable_create();
+		if (table == NULL) {
+			return ENOMEM;
+		}
+
+		/**
+		 * Author: Pratham Malik
+		 * Initialize PID to the process
+		 */
+		processid = allocate_pid();
+		if(processid==-1)
+		{
+			fdtable_destroy(table);
+			return ENPROC;
+		}
+		tid = 0;
 	}
+
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
+	thread->t_wchan = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
+	thread->t_lastrun = 0;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
+	thread->t_intr_from_user = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
@@ -177,25 +243,151 @@ thread_create(const char *name)
 	/* VFS fields */
 	thread->t_cwd = NULL;
 
+	/* Accounting */
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
+
+	/* Process fields */
+	thread->file_table = table;
+	thread->t_tid = tid;
+
 	/* If you add to struct thread, be sure to initialize here */
 
+	if (sibling) {
+		thread->t_pid = processid;
+	}
+	else {
+		initialize_pid(thread,processid);
+	}
 
-	/**
-	 * Author: Pratham Malik
-	 * Initialize PID to the process
-	 */
-	pid_t processid;
-	processid = allocate_pid();
-	if(processid==-1)
-	{
+	//End of Additions by Pratham Malik
+
+	return 0;
+}
+
+/*
+ * Undo thread_init for a thread that never ran.
+ */
+static
+void
+thread_uninit(struct thread *thread)
+{
+	if (thread->t_tid != 0) {
+		proc_thread_drop(thread->t_pid, thread->t_tid);
+	}
+	else {
+		fdtable_destroy(thread->file_table);
+		deallocate_pid(thread->t_pid);
+	}
+	thread->file_table = NULL;
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name, bool sibling)
+{
+	struct thread *thread;
+
+	DEBUGASSERT(name != NULL);
+
+	thread = kmalloc(sizeof(*thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	thread->t_name = NULL;
+	if (thread_setname(thread, name)) {
 		kfree(thread);
 		return NULL;
 	}
+	thread->t_stack = NULL;
 
-	initialize_pid(thread,processid);
+	if (thread_init(thread, sibling)) {
+		kfree(thread->t_name);
+		kfree(thread);
+		return NULL;
+	}
 
-	//End of Additions by Pratham Malik
+	return thread;
+}
+
+/*
+ * Thread recycling.
+ *
+ * Rather than being freed, threads reaped by exorcise() are kept,
+ * stack, name buffer and all, on a small per-cpu pool, and
+ * thread_fork takes them from there before allocating new ones. Like
+ * the zombie list, the pool is only ever touched by its own cpu, with
+ * interrupts off.
+ *
+ * THREAD_POOL_MAX bounds the memory parked in each pool (each entry
+ * holds a STACK_SIZE stack).
+ */
+#define THREAD_POOL_MAX		8
 
+/*
+ * Park a dead thread in the current cpu's pool. Returns false if it
+ * can't be pooled, in which case the caller should destroy it.
+ */
+static
+bool
+thread_pool_put(struct thread *thread)
+{
+	KASSERT(thread != curthread);
+	KASSERT(thread->t_state == S_ZOMBIE);
+	KASSERT(curthread->t_curspl > 0);
+
+	/* Boot threads have no stack of their own to recycle */
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadpool.tl_count >= THREAD_POOL_MAX) {
+		return false;
+	}
+
+	/* Same cleanup as thread_destroy, short of freeing */
+	KASSERT(thread->t_cwd == NULL);
+	KASSERT(thread->t_addrspace == NULL);
+	KASSERT(thread->file_table == NULL);
+	thread_machdep_cleanup(&thread->t_machdep);
+	thread->t_wchan_name = "POOLED";
+
+	threadlist_addhead(&curcpu->c_threadpool, thread);
+	return true;
+}
+
+/*
+ * Get a thread from the current cpu's pool and set it up as if by
+ * thread_create. The stack is already there. Returns NULL if the pool
+ * is empty or setup fails.
+ */
+static
+struct thread *
+thread_recycle(const char *name, bool sibling)
+{
+	struct thread *thread;
+	int spl;
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadpool);
+	if (thread == NULL) {
+		curcpu->c_threadpool_misses++;
+		splx(spl);
+		return NULL;
+	}
+	curcpu->c_threadpool_hits++;
+	splx(spl);
+
+	KASSERT(thread->t_stack != NULL);
+
+	if (thread_setname(thread, name) || thread_init(thread, sibling)) {
+		/* Nothing was changed that matters; put it back */
+		spl = splhigh();
+		threadlist_addhead(&curcpu->c_threadpool, thread);
+		splx(spl);
+		return NULL;
+	}
 
 	return thread;
 }
@@ -228,22 +420,42 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	c->c_busyclocks = 0;
+	c->c_idleclocks = 0;
+	c->c_loadavg[0] = c->c_loadavg[1] = c->c_loadavg[2] = 0;
+	c->c_slice = SLICE_HARDCLOCKS;
+	threadlist_init(&c->c_threadpool);
+	c->c_threadpool_hits = 0;
+	c->c_threadpool_misses = 0;
+
+	c->c_steal_cold = 0;
+	c->c_steal_hot = 0;
+	c->c_steal_declined = 0;
+	c->c_wake_hot = 0;
+	c->c_wake_home = 0;
+	c->c_wake_moved = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	spinlock_setname(&c->c_runqueue_lock, "runqueue");
 
 	c->c_ipi_pending = 0;
-	c->c_numshootdown = -1;
+	c->c_numshootdown = 0;
+	c->c_shootdowns_done = 0;
 	spinlock_init(&c->c_ipi_lock);
+	spinlock_setname(&c->c_ipi_lock, "ipi");
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+#if OPT_SYSCALLSTAT
+	syscallstat_cpuinit(c->c_number);
+#endif
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
-	c->c_curthread = thread_create(namebuf);
+	c->c_curthread = thread_create(namebuf, false);
 	if (c->c_curthread == NULL) {
 		panic("cpu_create: thread_create failed\n");
 	}
@@ -300,6 +512,9 @@ thread_destroy(struct thread *thread)
 	/* VM fields, cleaned up in thread_exit */
 	KASSERT(thread->t_addrspace == NULL);
 
+	/* Process fields, cleaned up in thread_exit or thread_uninit */
+	KASSERT(thread->file_table == NULL);
+
 	/* Thread subsystem fields */
 	if (thread->t_stack != NULL) {
 		kfree(thread->t_stack);
@@ -329,7 +544,9 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (!thread_pool_put(z)) {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -412,16 +629,9 @@ thread_bootstrap(void)
 
 	/*
 	 * Author:Pratham Malik
-	 * Initialize the structure for process to zero
+	 * Set up the process table
 	*/
-	int count=0;
-	for(count=0;count<PROCESS_MAX;count++)
-	{
-		process_array[count]=0;
-	}
-
-	//Create the pid_lock
-	pid_lock = lock_create("pid_lock");
+	proc_bootstrap();
 	//End of Addition by PM
 
 
@@ -510,7 +720,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 {
 
 	struct cpu *targetcpu;
-	bool isidle;
+	bool isidle, waits;
 
 	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
@@ -533,9 +743,29 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		ipi_send(targetcpu, IPI_UNIDLE);
 	}
 
-	if (!already_have_lock) {
+	/*
+	 * Does the thread have to wait? With the lock already held
+	 * we're in thread_switch requeueing the current thread, which
+	 * waits only if something else is queued ahead of it;
+	 * otherwise it waits if its cpu is busy.
+	 */
+	if (already_have_lock) {
+		waits = targetcpu->c_runqueue.tl_count > 1;
+	}
+	else {
+		waits = !isidle;
 		spinlock_release(&targetcpu->c_runqueue_lock);
 	}
+
+	/*
+	 * A tickless idle cpu doesn't look for work to steal until
+	 * something wakes it, so nudge one. If the thread is too
+	 * cache-hot to take yet, the idle cpu keeps ticking until it
+	 * isn't (see thread_switch).
+	 */
+	if (waits) {
+		thread_kick_idle(targetcpu);
+	}
 }
 
 /*
@@ -544,65 +774,83 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
  * The new thread has name NAME, and starts executing in function
  * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
  *
- * The new thread is given no address space (the caller decides that)
- * but inherits its current working directory from the caller. It will
- * start on the same CPU as the caller, unless the scheduler
- * intervenes first.
+ * If SIBLING, the new thread is part of the caller's process and
+ * shares its address space and file table. Otherwise it's a new
+ * process with a copy of both, or if !COPYAS a copy of the file table
+ * and no address space. A new process gets FDT instead of a copy of
+ * the file table if FDT isn't NULL; it's consumed only on success.
+ * Either way it inherits the caller's current working directory. It will start on the same CPU as the
+ * caller, unless the scheduler intervenes first.
+ *
+ * RET, if not NULL, gets the new thread and TID its thread id; both
+ * are filled in before the thread can run.
  */
+static
 int
-thread_fork(const char *name,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2,
-	    struct thread **ret)
+thread_fork_common(const char *name,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1, unsigned long data2, bool sibling,
+		   bool copyas, struct fdtable *fdt, struct thread **ret,
+		   int *tid)
 {
 	struct thread *newthread;
 	struct addrspace *childspace;
+	int result;
 
-	newthread = thread_create(name);
+	/* Reuse a thread and stack from the pool if there is one. */
+	newthread = thread_recycle(name, sibling);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name, sibling);
+		if (newthread == NULL) {
+			return sibling ? EAGAIN : ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		kfree(process_array[newthread->t_pid]);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_uninit(newthread);
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
 	}
 	thread_checkstack_init(newthread);
 
+	/* Nothing below may fail once FDT is installed */
+	KASSERT(fdt == NULL || (!sibling && !copyas));
+
+	/* A new process gets references to all our open files */
+	if (fdt != NULL) {
+		fdtable_destroy(newthread->file_table);
+		newthread->file_table = fdt;
+	}
+	else if (!sibling) {
+		result = fdtable_copy(curthread->file_table,
+				      newthread->file_table);
+		if (result) {
+			thread_uninit(newthread);
+			thread_destroy(newthread);
+			return result;
+		}
+	}
+
 	/*
 	 * Author: Pratham Malik
 	 * Copy the addrspace for the child
 	 */
-	int result;
-
-	if(curthread->t_addrspace!=NULL)
+	if (sibling) {
+		newthread->t_addrspace = curthread->t_addrspace;
+	}
+	else if(copyas && curthread->t_addrspace!=NULL)
 	{
-		/*childspace = kmalloc(sizeof(struct addrspace));
-		if(childspace == NULL)
-		{
-			kfree(process_array[newthread->t_pid]);
-			return ENOMEM;
-		}
-*/
 		result = as_copy(curthread->t_addrspace,&childspace);
 		if(result)
 		{
-			kfree(process_array[newthread->t_pid]);
+			thread_uninit(newthread);
+			thread_destroy(newthread);
 			return result;
-
 		}
 
-//		memcpy(newthread->t_addrspace,childspace,sizeof(childspace));
 		newthread->t_addrspace = childspace;
-
-		if(newthread->t_addrspace==NULL)
-		{
-			kfree(process_array[newthread->t_pid]);
-			return ENOMEM;
-		}
 	}
 	//End of additions by PM
 
@@ -613,9 +861,6 @@ thread_fork(const char *name,
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
 
-	/* VM fields */
-	/* do not clone address space -- let caller decide on that */
-
 	/* VFS fields */
 	if (curthread->t_cwd != NULL) {
 		VOP_INCREF(curthread->t_cwd);
@@ -625,28 +870,17 @@ thread_fork(const char *name,
 	/**
 	 * Author: Pratham Malik
 	 */
-
-	int counter=0;
-	for(counter=0;counter<__OPEN_MAX;counter++)
-	{
-		if(curthread->file_table[counter]!=0)
-		{
-			//newthread->file_table[counter]=kmalloc(sizeof(struct file_descriptor));
-			newthread->file_table[counter]=curthread->file_table[counter];
-			if(counter>2)
-				curthread->file_table[counter]->reference_count++;
-		}else
-		{
-			newthread->file_table[counter]=0;
+	if (!sibling) {
+		/*
+		 * Also make the new process our child, so we can wait
+		 * for it. If the caller didn't want the thread back it
+		 * has no way to wait for it, so leave it without a
+		 * parent to be reaped as soon as it exits.
+		 */
+		if (ret != NULL) {
+			proc_addchild(curthread->t_pid, newthread->t_pid);
 		}
 	}
-
-	//Also add the parent id to the process array entry for the new child
-	pid_t parent_id = curthread->t_pid;
-	pid_t child_id = newthread->t_pid;
-
-	process_array[child_id]->parent_id = parent_id;
-
 	//End by PM
 
 
@@ -662,14 +896,17 @@ thread_fork(const char *name,
 
 
 	/*
-	 * Return new thread structure if it's wanted. Note that using
-	 * the thread structure from the parent thread should be done
-	 * only with caution, because in general the child thread
-	 * might exit at any time.
+	 * Hand back what the caller wants before the new thread can
+	 * run. Note that using the thread structure from the parent
+	 * thread should be done only with caution, because in general
+	 * the child thread might exit at any time.
 	 */
 	if (ret != NULL) {
 		*ret = newthread;
 	}
+	if (tid != NULL) {
+		*tid = newthread->t_tid;
+	}
 
 	/* Lock the current cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
@@ -678,6 +915,38 @@ thread_fork(const char *name,
 	return 0;
 }
 
+int
+thread_fork(const char *name,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2,
+	    struct thread **ret)
+{
+	return thread_fork_common(name, entrypoint, data1, data2, false,
+				  true, NULL, ret, NULL);
+}
+
+int
+thread_fork_noas(const char *name,
+		 void (*entrypoint)(void *data1, unsigned long data2),
+		 void *data1, unsigned long data2,
+		 struct fdtable *fdt, struct thread **ret)
+{
+	return thread_fork_common(name, entrypoint, data1, data2, false,
+				  false, fdt, ret, NULL);
+}
+
+int
+thread_fork_sibling(const char *name,
+		    void (*entrypoint)(void *data1, unsigned long data2),
+		    void *data1, unsigned long data2,
+		    int *tid)
+{
+	KASSERT(curthread->file_table != NULL);
+
+	return thread_fork_common(name, entrypoint, data1, data2, true,
+				  false, NULL, NULL, tid);
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -724,6 +993,21 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		return;
 	}
 
+	/* Remember when we were last on this cpu, for cache affinity. */
+	cur->t_lastrun = curcpu->c_hardclocks;
+
+	/*
+	 * Count the switch. Going to sleep is voluntary; being put
+	 * back on the run queue is a preemption (normally from
+	 * hardclock).
+	 */
+	if (newstate == S_SLEEP) {
+		cur->t_usage.tu_nvcsw++;
+	}
+	else if (newstate == S_READY) {
+		cur->t_usage.tu_nivcsw++;
+	}
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
@@ -748,6 +1032,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		 * without racing. Exercise: what's the other?)
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
+		cur->t_wchan = wc;
 		wchan_unlock(wc);
 		break;
 	    case S_ZOMBIE:
@@ -780,12 +1065,30 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			/*
+			 * Before halting, try to pull work from a
+			 * busier cpu. If there's none to take, go
+			 * idle. Stop the clock tick while idle only
+			 * if no other cpu has threads waiting;
+			 * otherwise keep it, and look again each
+			 * tick until they can be taken.
+			 */
+			if (!thread_steal()) {
+				if (thread_work_elsewhere()) {
+					cpu_idle();
+				}
+				else {
+					hardclock_idle();
+				}
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	/* Start the new thread's time slice. */
+	curcpu->c_slice = SLICE_HARDCLOCKS;
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -930,6 +1233,8 @@ void
 thread_exit(void)
 {
 	struct thread *cur;
+	struct addrspace *as;
+	bool last;
 
 	cur = curthread;
 
@@ -939,30 +1244,35 @@ thread_exit(void)
 		cur->t_cwd = NULL;
 	}
 
-	/**
-	 * Author:Pratham Malik
-	 * clearing the thread new variables added due to ASST2
-	 * and decreasing the reference count for parent thread
-	 */
-
-
-
-	//End of additions by PM
-
 	/* VM fields */
-	if (cur->t_addrspace) {
+	as = cur->t_addrspace;
+	if (as) {
 		/*
 		 * Clear t_addrspace before calling as_destroy. Otherwise
 		 * if as_destroy sleeps (which is quite possible) when we
 		 * come back we'll call as_activate on a half-destroyed
 		 * address space, which is usually messily fatal.
 		 */
-		struct addrspace *as = cur->t_addrspace;
 		cur->t_addrspace = NULL;
 		as_activate(NULL);
-		as_destroy(as);
 	}
 
+	/*
+	 * Leave our process. This detaches us from its process table
+	 * entry, which may outlive us until the parent reaps it, so
+	 * nobody looks at this thread structure after it's been
+	 * destroyed. If we were the last thread, the process is done
+	 * with its address space and file table.
+	 */
+	last = proc_thread_exit(cur);
+	if (last) {
+		if (as) {
+			as_destroy(as);
+		}
+		fdtable_destroy(cur->file_table);
+	}
+	cur->file_table = NULL;
+
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
@@ -1005,126 +1315,321 @@ schedule(void)
 }
 #endif
 
+/*
+ * True if T ran on its cpu recently enough to still be cache-hot
+ * there. The other cpu's hardclock count is read without locking;
+ * this is only a heuristic.
+ */
+static
+bool
+thread_is_cache_hot(struct thread *t)
+{
+	return t->t_cpu->c_hardclocks - t->t_lastrun < CACHE_HOT_HARDCLOCKS;
+}
+
+/*
+ * Rough measure of how busy a cpu is: the number of threads queued,
+ * plus one for the one it's running if it isn't idle. Unlocked.
+ */
+static
+unsigned
+thread_cpuload(struct cpu *c)
+{
+	return c->c_runqueue.tl_count + (c->c_isidle ? 0 : 1);
+}
+
 /*
  * Thread migration.
  *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
+ * Load balancing is pull-based: a CPU that runs out of work steals a
+ * runnable thread from the busiest of its peers before it idles. This
+ * is called from thread_switch() with the current CPU's run queue
+ * unlocked, and takes only one remote run queue lock at a time.
  *
  * Migrating threads isn't free because of cache affinity; a thread's
  * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
+ * which is fairly slow. So we prefer to take a thread that hasn't run
+ * on the victim recently. A cache-hot thread is only taken if it would
+ * have to wait behind another thread anyway, by which time its cache
+ * footprint will have been mostly displaced.
+ *
+ * The choice of victim CPU is made by reading the other run queue
+ * counts without their locks. That's only a hint; the count is
+ * rechecked once the victim's lock is held.
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * Returns true if a thread was moved onto the current CPU's run queue.
  */
-void
-thread_consider_migration(void)
+static
+bool
+thread_steal(void)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
-	struct thread *t;
+	unsigned i, numcpus, count, best_count;
+	struct cpu *c, *victim;
+	struct threadlistnode *tln;
+	struct thread *t, *hot;
 
-	my_count = total_count = 0;
+	victim = NULL;
+	best_count = 0;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
 		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
+			continue;
 		}
-		spinlock_release(&c->c_runqueue_lock);
+		count = c->c_runqueue.tl_count;
+		if (count > best_count) {
+			best_count = count;
+			victim = c;
+		}
+	}
+	if (victim == NULL) {
+		return false;
 	}
 
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
-		return;
+	spinlock_acquire(&victim->c_runqueue_lock);
+	/*
+	 * Leave the victim alone if it's idle and has only one thread
+	 * queued; it is about to pick that thread up itself.
+	 */
+	if (victim->c_runqueue.tl_count == 0 ||
+	    (victim->c_isidle && victim->c_runqueue.tl_count == 1)) {
+		spinlock_release(&victim->c_runqueue_lock);
+		return false;
 	}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	/*
+	 * Search from the tail, which is the thread that would
+	 * otherwise wait longest, for one that's cache-cold.
+	 *
+	 * Skip the victim's curthread: it can appear on its own run
+	 * queue if it went to sleep, the CPU idled, and it was woken
+	 * again before the CPU finished unidling. Its stack is still
+	 * in use over there, so it must not be moved.
+	 */
+	t = hot = NULL;
+	for (tln = victim->c_runqueue.tl_tail.tln_prev;
+	     tln->tln_prev != NULL;
+	     tln = tln->tln_prev) {
+		if (tln->tln_self == victim->c_curthread) {
+			continue;
+		}
+		if (!thread_is_cache_hot(tln->tln_self)) {
+			t = tln->tln_self;
+			break;
+		}
+		if (hot == NULL) {
+			hot = tln->tln_self;
+		}
+	}
+
+	if (t != NULL) {
+		curcpu->c_steal_cold++;
+	}
+	else if (hot != NULL && victim->c_runqueue.tl_count > 1) {
+		t = hot;
+		curcpu->c_steal_hot++;
+	}
+	else {
+		if (hot != NULL) {
+			curcpu->c_steal_declined++;
+		}
+		spinlock_release(&victim->c_runqueue_lock);
+		return false;
 	}
+
+	threadlist_remove(&victim->c_runqueue, t);
+	t->t_cpu = curcpu->c_self;
+	spinlock_release(&victim->c_runqueue_lock);
+
+	DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u\n",
+	      t->t_name, victim->c_number, curcpu->c_number);
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	threadlist_addtail(&curcpu->c_runqueue, t);
 	spinlock_release(&curcpu->c_runqueue_lock);
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
+	return true;
+}
+
+/*
+ * True if any other cpu has threads waiting in its run queue. Read
+ * without locks; the idle loop rechecks on every tick anyway.
+ */
+static
+bool
+thread_work_elsewhere(void)
+{
+	unsigned i, numcpus;
+	struct cpu *c;
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
-			continue;
+		if (c != curcpu->c_self && c->c_runqueue.tl_count > 0) {
+			return true;
 		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
+	}
+	return false;
+}
 
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
+/*
+ * Wake one idle cpu (other than BUSY) so it runs thread_steal. The
+ * idle flags are read without locks; if we miss one, the work just
+ * waits for BUSY to get to it.
+ */
+static
+void
+thread_kick_idle(struct cpu *busy)
+{
+	unsigned i, numcpus;
+	struct cpu *c;
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != busy && c->c_isidle) {
+			ipi_send(c, IPI_UNIDLE);
+			return;
 		}
-		spinlock_release(&c->c_runqueue_lock);
 	}
+}
+
+/*
+ * Choose the cpu for a thread that is being woken up, by updating
+ * its t_cpu before it's made runnable.
+ *
+ * A thread that ran recently stays where it was so it can reuse its
+ * cache. One that has been asleep a while has nothing to lose by
+ * moving, so it goes to the least loaded cpu, preferring the one it
+ * was on in case of a tie.
+ *
+ * A thread that is still its home cpu's curthread (it went to sleep
+ * and that cpu has been idling on its stack ever since) must stay
+ * put.
+ */
+static
+void
+thread_wakeup_place(struct thread *target)
+{
+	struct cpu *home, *best, *c;
+	unsigned i, numcpus, load, best_load;
+	bool hot;
+
+	home = target->t_cpu;
 
 	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
+	 * The target may still be on its way out of thread_switch on
+	 * its home cpu, which holds its run queue lock until the
+	 * switch is done. Check c_curthread under that lock so we
+	 * never send a thread elsewhere before its context is saved.
 	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+	spinlock_acquire(&home->c_runqueue_lock);
+	hot = (target == home->c_curthread);
+	spinlock_release(&home->c_runqueue_lock);
+
+	if (hot || thread_is_cache_hot(target)) {
+		curcpu->c_wake_hot++;
+		return;
+	}
+
+	best = home;
+	best_load = thread_cpuload(home);
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus && best_load > 0; i++) {
+		c = cpuarray_get(&allcpus, i);
+		load = thread_cpuload(c);
+		if (load < best_load) {
+			best = c;
+			best_load = load;
 		}
-		spinlock_release(&curcpu->c_runqueue_lock);
 	}
 
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
+	if (best == home) {
+		curcpu->c_wake_home++;
+	}
+	else {
+		DEBUG(DB_THREADS, "Waking thread %s: cpu %u -> %u\n",
+		      target->t_name, home->c_number, best->c_number);
+		target->t_cpu = best;
+		curcpu->c_wake_moved++;
+	}
+}
+
+/*
+ * Print the placement counters for each cpu.
+ */
+void
+thread_printschedstats(void)
+{
+	unsigned i;
+	struct cpu *c;
+
+	kprintf("cpu   steal: cold    hot   declined  "
+		"wake: hot   home  moved\n");
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("%3u  %11u %6u %10u %10u %6u %6u\n",
+			c->c_number,
+			c->c_steal_cold, c->c_steal_hot, c->c_steal_declined,
+			c->c_wake_hot, c->c_wake_home, c->c_wake_moved);
+	}
+}
+
+/*
+ * Print busy and idle time and load averages for each cpu.
+ */
+void
+thread_printcpustats(void)
+{
+	unsigned i, j, total;
+	struct cpu *c;
+
+	kprintf("cpu   busy%%      busy(s)      idle(s)   "
+		"load: 1min  5min 15min\n");
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		total = c->c_busyclocks + c->c_idleclocks;
+		kprintf("%3u  %5u%% %12u %12u       ",
+			c->c_number,
+			total ? (c->c_busyclocks * 100) / total : 0,
+			c->c_busyclocks / HZ, c->c_idleclocks / HZ);
+		for (j=0; j<3; j++) {
+			kprintf(" %2u.%02u",
+				c->c_loadavg[j] >> LOADAVG_FSHIFT,
+				((c->c_loadavg[j] & (LOADAVG_FSCALE - 1))
+				 * 100) >> LOADAVG_FSHIFT);
+		}
+		kprintf("\n");
+	}
+}
+
+/*
+ * Print the thread pool occupancy and hit rate for each cpu.
+ */
+void
+thread_printpoolstats(void)
+{
+	unsigned i, total;
+	struct cpu *c;
+
+	kprintf("cpu  pooled       hits     misses   hit%%\n");
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		total = c->c_threadpool_hits + c->c_threadpool_misses;
+		kprintf("%3u  %6u %10u %10u   %3u%%\n",
+			c->c_number, c->c_threadpool.tl_count,
+			c->c_threadpool_hits, c->c_threadpool_misses,
+			total ? (c->c_threadpool_hits * 100) / total : 0);
+	}
+}
+
+void
+thread_usage_add(struct thread_usage *dest, const struct thread_usage *src)
+{
+	dest->tu_uclocks += src->tu_uclocks;
+	dest->tu_sclocks += src->tu_sclocks;
+	dest->tu_nvcsw += src->tu_nvcsw;
+	dest->tu_nivcsw += src->tu_nivcsw;
 }
 
 ////////////////////////////////////////////////////////////
@@ -1151,6 +1656,7 @@ wchan_create(const char *name)
 		return NULL;
 	}
 	spinlock_init(&wc->wc_lock);
+	spinlock_setname(&wc->wc_lock, name);
 	threadlist_init(&wc->wc_threads);
 	wc->wc_name = name;
 	return wc;
@@ -1198,6 +1704,82 @@ wchan_sleep(struct wchan *wc)
 	thread_switch(S_SLEEP, wc);
 }
 
+/*
+ * State for wchan_sleep_timeout, shared with the timeout function.
+ */
+struct wchan_timedsleep {
+	struct thread *wts_thread;	/* the sleeper */
+	struct wchan *wts_wc;		/* what it's sleeping on */
+	bool wts_expired;		/* true if the timeout woke it */
+};
+
+/*
+ * Timeout function for wchan_sleep_timeout. Runs from hardclock. If
+ * the thread is still on the channel, nobody has woken it yet; take
+ * it off and wake it ourselves.
+ */
+static
+void
+wchan_sleep_expire(void *data)
+{
+	struct wchan_timedsleep *wts = data;
+	struct thread *target = wts->wts_thread;
+	struct wchan *wc = wts->wts_wc;
+
+	spinlock_acquire(&wc->wc_lock);
+	if (target->t_wchan != wc) {
+		/* Already woken up */
+		spinlock_release(&wc->wc_lock);
+		return;
+	}
+	threadlist_remove(&wc->wc_threads, target);
+	target->t_wchan = NULL;
+	wts->wts_expired = true;
+	spinlock_release(&wc->wc_lock);
+
+	thread_wakeup_place(target);
+	thread_make_runnable(target, false);
+}
+
+/*
+ * Like wchan_sleep, but give up after TICKS hardclocks if nobody has
+ * woken us. Returns 0 if woken normally and ETIMEDOUT if the time ran
+ * out. As with wchan_sleep the channel must be locked, and will be
+ * unlocked upon return.
+ */
+int
+wchan_sleep_timeout(struct wchan *wc, unsigned ticks)
+{
+	struct wchan_timedsleep wts;
+	struct timeout to;
+
+	/* may not sleep in an interrupt handler */
+	KASSERT(!curthread->t_in_interrupt);
+
+	if (ticks == 0) {
+		wchan_unlock(wc);
+		return ETIMEDOUT;
+	}
+
+	wts.wts_thread = curthread;
+	wts.wts_wc = wc;
+	wts.wts_expired = false;
+	timeout_init(&to, wchan_sleep_expire, &wts);
+
+	/*
+	 * Arm the timeout while still holding the channel lock; the
+	 * timeout function needs that lock too, so it can't look for
+	 * us before thread_switch has put us on the list.
+	 */
+	timeout_add(&to, ticks);
+	thread_switch(S_SLEEP, wc);
+
+	/* wts and to are on our stack; make sure the timeout is done. */
+	timeout_del(&to);
+
+	return wts.wts_expired ? ETIMEDOUT : 0;
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1209,6 +1791,9 @@ wchan_wakeone(struct wchan *wc)
 	/* Lock the channel and grab a thread from it */
 	spinlock_acquire(&wc->wc_lock);
 	target = threadlist_remhead(&wc->wc_threads);
+	if (target != NULL) {
+		target->t_wchan = NULL;
+	}
 	/*
 	 * Nobody else can wake up this thread now, so we don't need
 	 * to hang onto the lock.
@@ -1221,6 +1806,7 @@ wchan_wakeone(struct wchan *wc)
 	}
 	DEBUG(DB_THREADS,
 				      "Waking thread UP");
+	thread_wakeup_place(target);
 	thread_make_runnable(target, false);
 }
 
@@ -1241,6 +1827,7 @@ wchan_wakeall(struct wchan *wc)
 	 */
 	spinlock_acquire(&wc->wc_lock);
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 	/*
@@ -1255,6 +1842,7 @@ wchan_wakeall(struct wchan *wc)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+		thread_wakeup_place(target);
 		thread_make_runnable(target, false);
 	}
 
@@ -1313,15 +1901,22 @@ ipi_broadcast(int code)
 	}
 }
 
+/*
+ * Queue MAPPING for TARGET and interrupt it. Must hold its IPI lock.
+ */
+static
 void
-ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+ipi_tlbshootdown_queue(struct cpu *target, const struct tlbshootdown *mapping)
 {
 	int n;
 
-	spinlock_acquire(&target->c_ipi_lock);
+	KASSERT(spinlock_do_i_hold(&target->c_ipi_lock));
 
 	n = target->c_numshootdown;
-	if (n == TLBSHOOTDOWN_MAX) {
+	if (n == TLBSHOOTDOWN_ALL) {
+		/* Already flushing everything */
+	}
+	else if (n == TLBSHOOTDOWN_MAX) {
 		target->c_numshootdown = TLBSHOOTDOWN_ALL;
 	}
 	else {
@@ -1331,7 +1926,13 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 
 	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
 	mainbus_send_ipi(target);
+}
 
+void
+ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+{
+	spinlock_acquire(&target->c_ipi_lock);
+	ipi_tlbshootdown_queue(target, mapping);
 	spinlock_release(&target->c_ipi_lock);
 }
 
@@ -1375,20 +1976,60 @@ interprocessor_interrupt(void)
 			}
 		}
 		curcpu->c_numshootdown = 0;
+		curcpu->c_shootdowns_done++;
 	}
 
 	curcpu->c_ipi_pending = 0;
 	spinlock_release(&curcpu->c_ipi_lock);
 }
 
+/*
+ * Invalidate MAPPING on every other cpu whose current thread is in
+ * MAPPING's address space, and wait until each has done it. Other
+ * cpus can't be holding entries for it: as_activate flushes the TLB
+ * whenever a thread with an address space is switched in. The caller
+ * must keep the mapping from being faulted back in meanwhile.
+ *
+ * We wait with interrupts on (the lock is dropped between checks), so
+ * that two cpus shooting at each other both get through.
+ */
+void
+ipi_tlbshootdown_sync(const struct tlbshootdown *mapping)
+{
+	unsigned i, numcpus, done;
+	struct thread *t;
+	struct cpu *c;
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		t = c->c_curthread;
+		if (c == curcpu->c_self || t == NULL ||
+		    t->t_addrspace != mapping->ts_addrspace) {
+			continue;
+		}
+
+		spinlock_acquire(&c->c_ipi_lock);
+		done = c->c_shootdowns_done;
+		ipi_tlbshootdown_queue(c, mapping);
+		while (c->c_shootdowns_done == done) {
+			spinlock_release(&c->c_ipi_lock);
+			spinlock_acquire(&c->c_ipi_lock);
+		}
+		spinlock_release(&c->c_ipi_lock);
+	}
+}
+
 void my_tlb_shhotdown(vaddr_t tlb_vaddr){
-	struct tlbshootdown *tlb_entry= kmalloc(sizeof(struct tlbshootdown));
-	tlb_entry->ts_vaddr= tlb_vaddr;
+	struct tlbshootdown tlb_entry;
+	tlb_entry.ts_addrspace = NULL;
+	tlb_entry.ts_vaddr= tlb_vaddr;
+	tlb_entry.ts_npages = 1;
 	struct cpu *c;
 	for (unsigned int i=0; i < cpuarray_num(&allcpus); i++) {
 		c = cpuarray_get(&allcpus, i);
 		if (c != curcpu->c_self) {
-				ipi_tlbshootdown(c, tlb_entry);
+				ipi_tlbshootdown(c, &tlb_entry);
 		}
 	}
 }
@@ -0,0 +1,387 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <timeout.h>
+
+/*
+ * Hierarchical timer wheel.
+ *
+ * The root level has one slot per tick for the next 256 ticks. Each
+ * of the three levels above it has 64 slots, each covering 64 times
+ * as many ticks as a slot of the level below. A timeout is placed in
+ * the finest level whose range covers it; whenever the root wraps
+ * around, the next slot of level 0 is cascaded (re-placed) into the
+ * root, and so on up. This covers 2^26 ticks (about a week at
+ * HZ=100) directly; anything further out is parked in the last slot
+ * of the top level and re-placed from there.
+ *
+ * Time is measured in hardclock ticks derived from the hardware
+ * clock (gettime), not by counting hardclock interrupts, so it keeps
+ * going while cpus sit idle without a periodic tick. The wheel is run
+ * by timerclock(), and after each run the timer device is set to go
+ * off at the next tick that has anything to do. Adding a timeout that
+ * is due before then moves the device's deadline up.
+ *
+ * Everything is protected by tw_lock. tw_clock is the next tick to
+ * be processed; timeout_run() processes ticks until it passes the
+ * current time.
+ */
+
+#define TW_ROOT_BITS	8
+#define TW_LEVEL_BITS	6
+#define TW_NLEVELS	3
+
+#define TW_ROOT_SIZE	(1U << TW_ROOT_BITS)
+#define TW_LEVEL_SIZE	(1U << TW_LEVEL_BITS)
+#define TW_ROOT_MASK	(TW_ROOT_SIZE - 1)
+#define TW_LEVEL_MASK	(TW_LEVEL_SIZE - 1)
+
+/* Position of level N's slot index within a tick count */
+#define TW_SHIFT(n)	(TW_ROOT_BITS + (n) * TW_LEVEL_BITS)
+
+/* Furthest out the wheel can hold a timeout directly */
+#define TW_MAXTICKS	((1U << TW_SHIFT(TW_NLEVELS)) - 1)
+
+/* Length of a tick */
+#define TW_NSEC_PER_TICK	(1000000000 / HZ)
+#define TW_USEC_PER_TICK	(1000000 / HZ)
+
+static struct spinlock tw_lock;
+static struct timeout *tw_root[TW_ROOT_SIZE];
+static struct timeout *tw_level[TW_NLEVELS][TW_LEVEL_SIZE];
+static struct timeout *tw_expired;	/* due this tick, not yet run */
+static struct timeout *tw_running;	/* function currently being called */
+static uint32_t tw_clock;		/* next tick to process */
+static bool tw_started;			/* tw_clock has been set */
+static bool tw_inrun;			/* timeout_run is in progress */
+static bool tw_armed;			/* timer device is set */
+static uint32_t tw_deadline;		/* tick it's set for */
+
+/*
+ * Read the hardware clock and convert to ticks. Only differences
+ * between tick values mean anything, so the wraparound of the 32-bit
+ * result is harmless. If NSECS is not NULL, the nanoseconds into the
+ * current tick are returned there.
+ */
+static
+uint32_t
+tw_now(uint32_t *nsecs)
+{
+	time_t secs;
+	uint32_t ns;
+
+	gettime(&secs, &ns);
+	if (nsecs != NULL) {
+		*nsecs = ns % TW_NSEC_PER_TICK;
+	}
+	return (uint32_t)secs * HZ + ns / TW_NSEC_PER_TICK;
+}
+
+/*
+ * Start the wheel at the current time, the first time it's used.
+ * (The hardware clock isn't available when timeout_bootstrap runs.)
+ */
+static
+void
+tw_sync(void)
+{
+	if (!tw_started) {
+		tw_clock = tw_now(NULL);
+		tw_started = true;
+	}
+}
+
+/*
+ * Slot list handling. The lists are doubly linked through to_prevp
+ * so a timeout can be pulled off whatever slot it's on in O(1).
+ */
+static
+void
+tw_insert(struct timeout **slot, struct timeout *to)
+{
+	KASSERT(to->to_prevp == NULL);
+
+	to->to_next = *slot;
+	if (to->to_next != NULL) {
+		to->to_next->to_prevp = &to->to_next;
+	}
+	to->to_prevp = slot;
+	*slot = to;
+}
+
+static
+void
+tw_remove(struct timeout *to)
+{
+	KASSERT(to->to_prevp != NULL);
+
+	*to->to_prevp = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_prevp = to->to_prevp;
+	}
+	to->to_next = NULL;
+	to->to_prevp = NULL;
+}
+
+/*
+ * Put TO in the right slot for its expiry time relative to tw_clock.
+ */
+static
+void
+tw_place(struct timeout *to)
+{
+	uint32_t when, delta;
+	struct timeout **slot;
+	unsigned n;
+
+	when = to->to_expire;
+	delta = when - tw_clock;
+	if ((int32_t)delta < 0) {
+		/* Already due; run it on the next tick. */
+		when = tw_clock;
+		delta = 0;
+	}
+
+	if (delta < TW_ROOT_SIZE) {
+		slot = &tw_root[when & TW_ROOT_MASK];
+	}
+	else {
+		if (delta > TW_MAXTICKS) {
+			when = tw_clock + TW_MAXTICKS;
+			delta = TW_MAXTICKS;
+		}
+		for (n = 0; delta >= (1U << TW_SHIFT(n+1)); n++) {
+			/* nothing */
+		}
+		slot = &tw_level[n][(when >> TW_SHIFT(n)) & TW_LEVEL_MASK];
+	}
+	tw_insert(slot, to);
+}
+
+/*
+ * Re-place everything in SLOT, which is now within range of the level
+ * below it.
+ */
+static
+void
+tw_cascade(struct timeout **slot)
+{
+	struct timeout *to;
+
+	while ((to = *slot) != NULL) {
+		tw_remove(to);
+		tw_place(to);
+	}
+}
+
+/*
+ * Find the next tick at which the wheel has work: the first nonempty
+ * root slot, or the next time the root wraps and the levels above
+ * need cascading, whichever comes first.
+ */
+static
+uint32_t
+tw_next(void)
+{
+	uint32_t t;
+
+	t = tw_clock;
+	if ((t & TW_ROOT_MASK) == 0) {
+		/* Cascade pending */
+		return t;
+	}
+	do {
+		if (tw_root[t & TW_ROOT_MASK] != NULL) {
+			return t;
+		}
+		t++;
+	} while ((t & TW_ROOT_MASK) != 0);
+
+	return t;
+}
+
+/*
+ * Set the timer device to call timerclock() at the start of tick
+ * DEADLINE.
+ */
+static
+void
+tw_arm(uint32_t deadline)
+{
+	uint32_t now, nsecs, delta, usecs;
+
+	now = tw_now(&nsecs);
+	delta = deadline - now;
+	if ((int32_t)delta <= 0) {
+		usecs = 1;
+	}
+	else {
+		usecs = delta * TW_USEC_PER_TICK - nsecs / 1000;
+	}
+	if (timerclock_set(usecs)) {
+		tw_armed = true;
+		tw_deadline = deadline;
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+void
+timeout_bootstrap(void)
+{
+	spinlock_init(&tw_lock);
+	spinlock_setname(&tw_lock, "timeout");
+	tw_clock = 0;
+	tw_started = false;
+	tw_inrun = false;
+	tw_armed = false;
+}
+
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *arg)
+{
+	to->to_next = NULL;
+	to->to_prevp = NULL;
+	to->to_expire = 0;
+	to->to_func = func;
+	to->to_arg = arg;
+}
+
+void
+timeout_add(struct timeout *to, unsigned ticks)
+{
+	spinlock_acquire(&tw_lock);
+	tw_sync();
+	if (to->to_prevp != NULL) {
+		tw_remove(to);
+	}
+	to->to_expire = tw_now(NULL) + 1 + ticks;
+	tw_place(to);
+
+	/*
+	 * If this is due before the timer device is set to go off,
+	 * set it sooner. (If the wheel is running right now it'll set
+	 * the device itself when it's done.)
+	 */
+	if (!tw_inrun &&
+	    (!tw_armed || (int32_t)(to->to_expire - tw_deadline) < 0)) {
+		tw_arm(to->to_expire);
+	}
+	spinlock_release(&tw_lock);
+}
+
+bool
+timeout_del(struct timeout *to)
+{
+	bool pending;
+
+	spinlock_acquire(&tw_lock);
+
+	/*
+	 * If the function is running right now (on another cpu; it
+	 * can't be on this one, or we'd be inside it) wait for it, so
+	 * the caller can safely throw TO away.
+	 */
+	while (tw_running == to) {
+		spinlock_release(&tw_lock);
+		spinlock_acquire(&tw_lock);
+	}
+
+	pending = (to->to_prevp != NULL);
+	if (pending) {
+		tw_remove(to);
+	}
+	spinlock_release(&tw_lock);
+
+	return pending;
+}
+
+bool
+timeout_pending(struct timeout *to)
+{
+	return to->to_prevp != NULL;
+}
+
+uint32_t
+timeout_ticks(void)
+{
+	return tw_now(NULL);
+}
+
+/*
+ * Process one tick: cascade from the upper levels if the root just
+ * wrapped, then call everything in the root slot for this tick. Must
+ * hold tw_lock, which is dropped while calling the functions.
+ */
+static
+void
+tw_tick(void)
+{
+	struct timeout *to;
+	unsigned n, index;
+
+	if ((tw_clock & TW_ROOT_MASK) == 0) {
+		for (n = 0; n < TW_NLEVELS; n++) {
+			index = (tw_clock >> TW_SHIFT(n)) & TW_LEVEL_MASK;
+			tw_cascade(&tw_level[n][index]);
+			if (index != 0) {
+				break;
+			}
+		}
+	}
+
+	/*
+	 * Move the due timeouts onto tw_expired so that anything
+	 * added while we're calling them goes to a later tick, and
+	 * so timeout_del can still pull them off.
+	 */
+	KASSERT(tw_expired == NULL);
+	tw_expired = tw_root[tw_clock & TW_ROOT_MASK];
+	if (tw_expired != NULL) {
+		tw_expired->to_prevp = &tw_expired;
+	}
+	tw_root[tw_clock & TW_ROOT_MASK] = NULL;
+	tw_clock++;
+
+	while ((to = tw_expired) != NULL) {
+		tw_remove(to);
+		tw_running = to;
+		spinlock_release(&tw_lock);
+
+		to->to_func(to->to_arg);
+
+		spinlock_acquire(&tw_lock);
+		tw_running = NULL;
+	}
+}
+
+/*
+ * Run everything that has come due, then set the timer device for
+ * the next tick with work to do.
+ */
+void
+timeout_run(void)
+{
+	uint32_t now;
+
+	spinlock_acquire(&tw_lock);
+	if (tw_inrun) {
+		spinlock_release(&tw_lock);
+		return;
+	}
+	tw_inrun = true;
+	tw_armed = false;
+	tw_sync();
+
+	now = tw_now(NULL);
+	while ((int32_t)(now - tw_clock) >= 0) {
+		tw_tick();
+		/* The functions may have taken a while */
+		now = tw_now(NULL);
+	}
+
+	tw_inrun = false;
+	tw_arm(tw_next());
+	spinlock_release(&tw_lock);
+}
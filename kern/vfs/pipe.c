@@ -0,0 +1,539 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <synch.h>
+#include <vnode.h>
+#include <vm.h>
+#include <pipe.h>
+
+/*
+ * Pipe vnodes.
+ *
+ * The reader takes data from p_head and the writer adds it after the
+ * last byte, each copying between the ring and the user's buffer with
+ * p_lock released, so a reader and a writer can copy at the same
+ * time. That's safe because the reader only gives up its bytes, and
+ * the writer only publishes its bytes, after the copy is done. p_rlock
+ * and p_wlock keep it to one reader and one writer at a time.
+ *
+ * A reader sleeps only when the pipe is empty and a writer only when
+ * it is full, so each side wakes the other only on the transition out
+ * of that state, and only if the other side is actually asleep.
+ *
+ * p_lock is a spinlock, never held across a copy, so closing an end
+ * (which happens with the VFS big lock held) never has to wait for a
+ * copy that is paging.
+ */
+
+struct pipe {
+	struct vnode p_rvn;		/* read end */
+	struct vnode p_wvn;		/* write end */
+	struct lock *p_rlock;		/* one reader at a time */
+	struct lock *p_wlock;		/* one writer at a time */
+	struct wchan *p_rwchan;		/* reader waits here for data */
+	struct wchan *p_wwchan;		/* writer waits here for room */
+	char *p_buf;
+	size_t p_size;
+
+	struct spinlock p_lock;		/* covers the rest */
+	size_t p_head;			/* first byte of data */
+	size_t p_count;			/* bytes of data */
+	bool p_rsleep;			/* reader on p_rwchan */
+	bool p_wsleep;			/* writer on p_wwchan */
+	bool p_ropen;			/* read end still open */
+	bool p_wopen;			/* write end still open */
+	unsigned p_ends;		/* ends not yet reclaimed */
+};
+
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	if (p->p_wwchan != NULL) {
+		wchan_destroy(p->p_wwchan);
+	}
+	if (p->p_rwchan != NULL) {
+		wchan_destroy(p->p_rwchan);
+	}
+	if (p->p_wlock != NULL) {
+		lock_destroy(p->p_wlock);
+	}
+	if (p->p_rlock != NULL) {
+		lock_destroy(p->p_rlock);
+	}
+	if (p->p_buf != NULL) {
+		kfree(p->p_buf);
+	}
+	spinlock_cleanup(&p->p_lock);
+	kfree(p);
+}
+
+/*
+ * Called for each open(). Pipes can't be opened by name, so this is
+ * never reached.
+ */
+static
+int
+pipe_open(struct vnode *v, int flags)
+{
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+/*
+ * Called on the last close of an end. Let the other side know: a
+ * sleeping reader sees EOF, and a sleeping writer gets EPIPE.
+ */
+static
+int
+pipe_close(struct vnode *v)
+{
+	struct pipe *p = v->vn_data;
+
+	spinlock_acquire(&p->p_lock);
+	if (v == &p->p_rvn) {
+		p->p_ropen = false;
+		if (p->p_wsleep) {
+			p->p_wsleep = false;
+			wchan_wakeall(p->p_wwchan);
+		}
+	}
+	else {
+		p->p_wopen = false;
+		if (p->p_rsleep) {
+			p->p_rsleep = false;
+			wchan_wakeall(p->p_rwchan);
+		}
+	}
+	spinlock_release(&p->p_lock);
+	return 0;
+}
+
+/*
+ * Called when an end's refcount reaches zero. The pipe goes when both
+ * ends have.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *p = v->vn_data;
+	bool last;
+
+	if (v->vn_refcount != 1) {
+		return EBUSY;
+	}
+	VOP_CLEANUP(v);
+
+	spinlock_acquire(&p->p_lock);
+	KASSERT(p->p_ends > 0);
+	p->p_ends--;
+	last = (p->p_ends == 0);
+	spinlock_release(&p->p_lock);
+
+	if (last) {
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+/*
+ * Sleep on WC with p_lock held; it is held again on return. SLEEPING
+ * is cleared by whoever wakes us.
+ */
+static
+void
+pipe_sleep(struct pipe *p, struct wchan *wc, bool *sleeping)
+{
+	*sleeping = true;
+	wchan_lock(wc);
+	spinlock_release(&p->p_lock);
+	wchan_sleep(wc);
+	spinlock_acquire(&p->p_lock);
+}
+
+/*
+ * Read whatever is there, up to the size of the request. Sleep only
+ * if there is nothing, and return nothing (EOF) if there never will
+ * be.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	size_t head, n;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+	if (v != &p->p_rvn) {
+		return EBADF;
+	}
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(p->p_rlock);
+	spinlock_acquire(&p->p_lock);
+	while (p->p_count == 0 && p->p_wopen) {
+		pipe_sleep(p, p->p_rwchan, &p->p_rsleep);
+	}
+
+	result = 0;
+	while (uio->uio_resid > 0 && p->p_count > 0) {
+		/* Up to the end of the data or of the ring, whichever first */
+		head = p->p_head;
+		n = p->p_size - head;
+		if (n > p->p_count) {
+			n = p->p_count;
+		}
+		if (n > uio->uio_resid) {
+			n = uio->uio_resid;
+		}
+		spinlock_release(&p->p_lock);
+
+		result = uiomove(p->p_buf + head, n, uio);
+
+		spinlock_acquire(&p->p_lock);
+		if (result) {
+			break;
+		}
+		p->p_head = (head + n) % p->p_size;
+		p->p_count -= n;
+
+		/* A writer only sleeps on a full pipe; it isn't now */
+		if (p->p_wsleep) {
+			p->p_wsleep = false;
+			wchan_wakeall(p->p_wwchan);
+		}
+	}
+	spinlock_release(&p->p_lock);
+	lock_release(p->p_rlock);
+
+	return result;
+}
+
+/*
+ * Write all of it, sleeping whenever the pipe is full. If the read
+ * end goes away, stop; that's EPIPE if nothing was written yet and a
+ * short write otherwise.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	size_t start, tail, n;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+	if (v != &p->p_wvn) {
+		return EBADF;
+	}
+	start = uio->uio_resid;
+
+	lock_acquire(p->p_wlock);
+	spinlock_acquire(&p->p_lock);
+
+	result = 0;
+	while (uio->uio_resid > 0) {
+		if (!p->p_ropen) {
+			if (uio->uio_resid == start) {
+				result = EPIPE;
+			}
+			break;
+		}
+		if (p->p_count == p->p_size) {
+			pipe_sleep(p, p->p_wwchan, &p->p_wsleep);
+			continue;
+		}
+
+		/* Up to the end of the room or of the ring, whichever first */
+		tail = (p->p_head + p->p_count) % p->p_size;
+		n = p->p_size - tail;
+		if (n > p->p_size - p->p_count) {
+			n = p->p_size - p->p_count;
+		}
+		if (n > uio->uio_resid) {
+			n = uio->uio_resid;
+		}
+		spinlock_release(&p->p_lock);
+
+		result = uiomove(p->p_buf + tail, n, uio);
+
+		spinlock_acquire(&p->p_lock);
+		if (result) {
+			break;
+		}
+		p->p_count += n;
+
+		/* A reader only sleeps on an empty pipe; it isn't now */
+		if (p->p_rsleep) {
+			p->p_rsleep = false;
+			wchan_wakeall(p->p_rwchan);
+		}
+	}
+	spinlock_release(&p->p_lock);
+	lock_release(p->p_wlock);
+
+	return result;
+}
+
+/*
+ * Used for several functions with the same type signature that are
+ * not meaningful on pipes.
+ */
+static
+int
+pipe_badio(struct vnode *v, struct uio *uio)
+{
+	(void)v;
+	(void)uio;
+	return EINVAL;
+}
+
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+/*
+ * The size of a pipe is how much is waiting to be read.
+ */
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *p = v->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = p->p_size;
+
+	spinlock_acquire(&p->p_lock);
+	statbuf->st_size = p->p_count;
+	spinlock_release(&p->p_lock);
+
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+int
+pipe_tryseek(struct vnode *v, off_t pos)
+{
+	(void)v;
+	(void)pos;
+	return ESPIPE;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
+static
+int
+pipe_mmap(struct vnode *v)
+{
+	(void)v;
+	return EUNIMP;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * Operations that are meaningless on pipes.
+ */
+
+static
+int
+pipe_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
+	   struct vnode **result)
+{
+	(void)v;
+	(void)name;
+	(void)excl;
+	(void)mode;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_symlink(struct vnode *v, const char *contents, const char *name)
+{
+	(void)v;
+	(void)contents;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_mkdir(struct vnode *v, const char *name, mode_t mode)
+{
+	(void)v;
+	(void)name;
+	(void)mode;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_link(struct vnode *v, const char *name, struct vnode *file)
+{
+	(void)v;
+	(void)name;
+	(void)file;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_nameop(struct vnode *v, const char *name)
+{
+	(void)v;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_rename(struct vnode *v, const char *n1, struct vnode *v2, const char *n2)
+{
+	(void)v;
+	(void)n1;
+	(void)v2;
+	(void)n2;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookup(struct vnode *dir, char *pathname, struct vnode **result)
+{
+	(void)dir;
+	(void)pathname;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookparent(struct vnode *dir, char *pathname, struct vnode **result,
+		char *namebuf, size_t buflen)
+{
+	(void)dir;
+	(void)pathname;
+	(void)result;
+	(void)namebuf;
+	(void)buflen;
+	return ENOTDIR;
+}
+
+/*
+ * Function table for both ends of a pipe.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	VOP_MAGIC,
+
+	pipe_open,
+	pipe_close,
+	pipe_reclaim,
+	pipe_read,
+	pipe_badio,   /* readlink */
+	pipe_badio,   /* getdirentry */
+	pipe_badio,   /* getdirentries */
+	pipe_write,
+	pipe_ioctl,
+	pipe_stat,
+	pipe_gettype,
+	pipe_tryseek,
+	pipe_fsync,
+	pipe_mmap,
+	pipe_truncate,
+	pipe_badio,   /* namefile */
+	pipe_creat,
+	pipe_symlink,
+	pipe_mkdir,
+	pipe_link,
+	pipe_nameop,  /* remove */
+	pipe_nameop,  /* rmdir */
+	pipe_rename,
+	pipe_lookup,
+	pipe_lookparent,
+};
+
+int
+pipe_create(size_t size, struct vnode **rvn, struct vnode **wvn)
+{
+	struct pipe *p;
+
+	KASSERT(size > 0);
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&p->p_lock);
+	p->p_buf = kmalloc(size);
+	p->p_rlock = lock_create("pipe-read");
+	p->p_wlock = lock_create("pipe-write");
+	p->p_rwchan = wchan_create("pipe-read");
+	p->p_wwchan = wchan_create("pipe-write");
+	if (p->p_buf == NULL || p->p_rlock == NULL || p->p_wlock == NULL ||
+	    p->p_rwchan == NULL || p->p_wwchan == NULL) {
+		pipe_destroy(p);
+		return ENOMEM;
+	}
+	p->p_size = size;
+	p->p_head = 0;
+	p->p_count = 0;
+	p->p_rsleep = false;
+	p->p_wsleep = false;
+	p->p_ropen = true;
+	p->p_wopen = true;
+	p->p_ends = 2;
+
+	VOP_INIT(&p->p_rvn, &pipe_vnode_ops, NULL, p);
+	VOP_INIT(&p->p_wvn, &pipe_vnode_ops, NULL, p);
+
+	/* As vfs_open would */
+	VOP_INCOPEN(&p->p_rvn);
+	VOP_INCOPEN(&p->p_wvn);
+
+	*rvn = &p->p_rvn;
+	*wvn = &p->p_wvn;
+	return 0;
+}
@@ -42,6 +42,8 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <clock.h>
+#include <kern/mman.h>
+#include <cpu.h>
 
 /*
  * Note! If OPT_DUMBVM is set, as is the case until you start the VM
@@ -180,6 +182,7 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 
 		as->regions->va_start = vaddr;
 		as->regions->region_numpages= npages;
+		as->regions->region_type = REGION_LOAD;
 		as->regions->va_end = (as->regions->va_start + (npages * PAGE_SIZE));
 
 
@@ -198,6 +201,7 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 
 		end->va_start = vaddr;
 		end->region_numpages= npages;
+		end->region_type = REGION_LOAD;
 		end->va_end = (end->va_start + (npages * PAGE_SIZE));
 
 		end->next_region = NULL;
@@ -324,6 +328,191 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+/*
+ * Anonymous mappings.
+ *
+ * An anonymous region is just a region of type REGION_ANON; vm_fault
+ * already gives any page in a region a zeroed frame the first time it
+ * is touched, and as_copy and as_destroy already handle its pages like
+ * any other's. All that's left is finding room for it and taking it
+ * out again. Both hold vm_fault_lock, as vm_fault does while it walks
+ * the region list and the page table.
+ */
+
+int
+as_map_anon(struct addrspace *as, size_t len, int prot, vaddr_t *vaddr)
+{
+	struct addr_regions *region, *r;
+	vaddr_t start, top;
+	size_t sz;
+
+	top = USERSTACK - VM_STACKPAGES * PAGE_SIZE;
+	sz = ROUNDUP(len, PAGE_SIZE);
+	if (len == 0) {
+		return EINVAL;
+	}
+	if (sz < len || sz > top - MMAP_BASE) {
+		return ENOMEM;
+	}
+
+	region = kmalloc(sizeof(*region));
+	if (region == NULL) {
+		return ENOMEM;
+	}
+
+	lock_acquire(vm_fault_lock);
+
+	/* First fit: skip past whatever is in the way until nothing is */
+	start = MMAP_BASE;
+	r = as->regions;
+	while (r != NULL && start + sz <= top) {
+		if (r->va_start < start + sz && r->va_end > start) {
+			start = r->va_end;
+			r = as->regions;
+		}
+		else {
+			r = r->next_region;
+		}
+	}
+	if (start + sz > top) {
+		lock_release(vm_fault_lock);
+		kfree(region);
+		return ENOMEM;
+	}
+
+	/* Permissions are kept as ELF PF_ bits, as load_elf gives them */
+	region->va_start = start;
+	region->va_end = start + sz;
+	region->region_numpages = sz / PAGE_SIZE;
+	region->region_type = REGION_ANON;
+	region->set_permissions = ((prot & PROT_READ) ? 4 : 0) +
+		((prot & PROT_WRITE) ? 2 : 0) + ((prot & PROT_EXEC) ? 1 : 0);
+	region->new_permission = 0;
+	region->next_region = as->regions;
+	as->regions = region;
+
+	lock_release(vm_fault_lock);
+
+	*vaddr = start;
+	return 0;
+}
+
+/*
+ * Free the pages mapped in [START, END) and drop them from the page
+ * table and this cpu's TLB. Must hold vm_fault_lock, and have shot
+ * the range down on the other cpus.
+ */
+static
+void
+as_freerange(struct addrspace *as, vaddr_t start, vaddr_t end)
+{
+	struct page_table_entry **pp, *pte;
+	int i, spl;
+
+	pp = &as->page_table;
+	while ((pte = *pp) != NULL) {
+		if (pte->va < start || pte->va >= end) {
+			pp = &pte->next;
+			continue;
+		}
+		*pp = pte->next;
+
+		if (pte->present) {
+			spl = splhigh();
+			i = tlb_probe(pte->va, 0);
+			if (i >= 0) {
+				tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+			}
+			splx(spl);
+			page_free(pte->pa);
+		}
+		else {
+			/* Release its swap slot, as as_destroy does */
+			swap_info[pte->swapfile_index]->va = 0;
+		}
+		kfree(pte);
+	}
+}
+
+int
+as_unmap(struct addrspace *as, vaddr_t vaddr, size_t len)
+{
+	struct addr_regions **rp, *r, *upper;
+	struct tlbshootdown ts;
+	vaddr_t end, start, stop;
+
+	if (vaddr % PAGE_SIZE != 0 || len == 0) {
+		return EINVAL;
+	}
+	end = vaddr + ROUNDUP(len, PAGE_SIZE);
+	if (end <= vaddr || end > USERSPACETOP) {
+		return EINVAL;
+	}
+
+	/* In case a region has to be split in two */
+	upper = kmalloc(sizeof(*upper));
+	if (upper == NULL) {
+		return ENOMEM;
+	}
+
+	lock_acquire(vm_fault_lock);
+
+	/*
+	 * Other threads of the process may be running on other cpus
+	 * with the pages in their TLBs. Invalidate them there before
+	 * any page is freed; with vm_fault_lock held nothing can fault
+	 * them back in.
+	 */
+	ts.ts_addrspace = as;
+	ts.ts_vaddr = vaddr;
+	ts.ts_npages = (end - vaddr) / PAGE_SIZE;
+	ipi_tlbshootdown_sync(&ts);
+
+	rp = &as->regions;
+	while ((r = *rp) != NULL) {
+		if (r->region_type != REGION_ANON ||
+		    r->va_end <= vaddr || r->va_start >= end) {
+			rp = &r->next_region;
+			continue;
+		}
+
+		start = r->va_start > vaddr ? r->va_start : vaddr;
+		stop = r->va_end < end ? r->va_end : end;
+		as_freerange(as, start, stop);
+
+		if (start == r->va_start && stop == r->va_end) {
+			*rp = r->next_region;
+			kfree(r);
+			continue;
+		}
+		if (start == r->va_start) {
+			r->va_start = stop;
+		}
+		else if (stop == r->va_end) {
+			r->va_end = start;
+		}
+		else {
+			/* A hole in the middle; only one region can have that */
+			KASSERT(upper != NULL);
+			*upper = *r;
+			upper->va_start = stop;
+			upper->region_numpages =
+				(upper->va_end - upper->va_start) / PAGE_SIZE;
+			r->va_end = start;
+			r->next_region = upper;
+			upper = NULL;
+		}
+		r->region_numpages = (r->va_end - r->va_start) / PAGE_SIZE;
+		rp = &r->next_region;
+	}
+	lock_release(vm_fault_lock);
+
+	if (upper != NULL) {
+		kfree(upper);
+	}
+	return 0;
+}
+
 
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
@@ -352,6 +541,7 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 			newregionshead= new->regions;
 			new->regions->va_start= old->regions->va_start;
 			new->regions->region_numpages= old->regions->region_numpages;
+			new->regions->region_type= old->regions->region_type;
 			new->regions->set_permissions= old->regions->set_permissions;
 			new->regions->va_end= old->regions->va_end;
 			old->regions= old->regions->next_region;
@@ -370,6 +560,7 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 		{
 				new->regions->va_start= old->regions->va_start;
 				new->regions->region_numpages= old->regions->region_numpages;
+				new->regions->region_type= old->regions->region_type;
 				new->regions->set_permissions= old->regions->set_permissions;
 				new->regions->va_end= old->regions->va_end;
 				old->regions= old->regions->next_region;
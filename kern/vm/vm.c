@@ -74,7 +74,7 @@ int32_t total_systempages;
 int32_t coremap_pages;
 struct coremap_entry *coremap;
 bool coremap_initialized;
-struct spinlock coremap_lock= SPINLOCK_INITIALIZER;
+struct spinlock coremap_lock= SPINLOCK_INITIALIZER_NAMED("coremap_lock");
 
 struct swap_elements *swap_info[SWAP_MAX];
 struct lock *swap_lock;
@@ -509,20 +509,34 @@ free_kpages(vaddr_t addr)
 void
 vm_tlbshootdown_all(void)
 {
-	panic("dumbvmXXXXXXXX tried to do tlb shootdown?!\n");
+	int i, spl;
+
+	spl = splhigh();
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	splx(spl);
 }
 
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
+	unsigned n;
 	int i, spl;
-	spl = splhigh();
 
-	i = tlb_probe(ts->ts_vaddr, 0);
-	if(i>0){
-		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	/* Past a TLB's worth of pages it's cheaper to flush the lot */
+	if (ts->ts_npages > NUM_TLB) {
+		vm_tlbshootdown_all();
+		return;
 	}
 
+	spl = splhigh();
+	for (n=0; n<ts->ts_npages; n++) {
+		i = tlb_probe(ts->ts_vaddr + n * PAGE_SIZE, 0);
+		if (i >= 0) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		}
+	}
 	splx(spl);
 }
 
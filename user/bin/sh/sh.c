@@ -69,18 +69,21 @@ static int timing = 0;
 #define MAXBG 128
 static pid_t bgpids[MAXBG];
 
+/* most commands in one pipeline */
+#define MAXSTAGES 16
+
 /*
  * can_bg
- * just checks for an open slot.
+ * just checks for N open slots.
  */
 static
 int
-can_bg(void)
+can_bg(int n)
 {
 	int i;
 	
 	for (i = 0; i < MAXBG; i++) {
-		if (bgpids[i] == 0) {
+		if (bgpids[i] == 0 && --n == 0) {
 			return 1;
 		}
 	}
@@ -292,21 +295,86 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * runstage
+ * starts the program in ARGS with its standard input and output on INFD
+ * and OUTFD.  returns its pid, or -1 after complaining.
+ */
+static
+pid_t
+runstage(char **args, int infd, int outfd)
+{
+	pid_t pid;
+#ifndef HOST
+	int fdmap[3];
+
+	/* Start the program directly; no need to copy ourselves first */
+	if (infd == STDIN_FILENO && outfd == STDOUT_FILENO) {
+		pid = spawn(args[0], args, NULL, 0);
+	}
+	else {
+		/* Give it just the three standard fds */
+		fdmap[STDIN_FILENO] = infd;
+		fdmap[STDOUT_FILENO] = outfd;
+		fdmap[STDERR_FILENO] = STDERR_FILENO;
+		pid = spawn(args[0], args, fdmap, 3);
+	}
+	if (pid < 0) {
+		warn("%s", args[0]);
+	}
+#else
+	pid = fork();
+	switch (pid) {
+		case -1:
+			/* error */
+			warn("fork");
+			break;
+		case 0:
+			/* child */
+			if (infd != STDIN_FILENO) {
+				dup2(infd, STDIN_FILENO);
+				close(infd);
+			}
+			if (outfd != STDOUT_FILENO) {
+				dup2(outfd, STDOUT_FILENO);
+				close(outfd);
+			}
+			execv(args[0], args);
+			warn("%s", args[0]);
+			/*
+			 * Use _exit() instead of exit() in the child
+			 * process to avoid calling atexit() functions,
+			 * which would cause hostcompat (if present) to
+			 * reset the tty state and mess up our input
+			 * handling.
+			 */
+			_exit(1);
+		default:
+			break;
+	}
+#endif
+	return pid;
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * otherwise, it's a standard command, or several joined by "|" into a
+ * pipeline, each reading what the one before it writes.  check for the
+ * '&', try to background the job if possible, otherwise just run it and
+ * wait on it.  the status of a pipeline is that of its last command.
  */
 static
 int
 docommand(char *buf)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
+	char **stages[MAXSTAGES];
+	pid_t pids[MAXSTAGES];
+	int nargs, nstages, nrun, i;
+	int infd, fds[2];
 	char *s;
-	pid_t pid;
 	int status;
 	int bg=0;
 	time_t startsecs, endsecs;
@@ -339,54 +407,92 @@ docommand(char *buf)
 
 	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
 		/* background */
-		if (!can_bg()) {
-			printf("%s: Too many background jobs; wait for "
-			       "some to finish before starting more\n",
-			       args[0]);
-			return -1;
-		}
 		nargs--;
 		args[nargs] = NULL;
 		bg = 1;
 	}
 
+	/* split the pipeline into its commands */
+	stages[0] = args;
+	nstages = 1;
+	for (i=0; i<nargs; i++) {
+		if (strcmp(args[i], "|")) {
+			continue;
+		}
+		if (nstages >= MAXSTAGES) {
+			printf("%s: Too many commands in pipeline\n", args[0]);
+			return 1;
+		}
+		args[i] = NULL;
+		stages[nstages++] = &args[i+1];
+	}
+	for (i=0; i<nstages; i++) {
+		if (stages[i][0] == NULL) {
+			printf("sh: Missing command in pipeline\n");
+			return 1;
+		}
+	}
+
+	if (bg && !can_bg(nstages)) {
+		printf("%s: Too many background jobs; wait for "
+		       "some to finish before starting more\n",
+		       args[0]);
+		return -1;
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			return _MKWAIT_EXIT(255);
-		case 0:
-			/* child */
-			execv(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
+	/* start each command reading from the pipe the one before writes */
+	infd = STDIN_FILENO;
+	for (nrun=0; nrun<nstages; nrun++) {
+		fds[0] = -1;
+		fds[1] = STDOUT_FILENO;
+		if (nrun < nstages-1 && pipe(fds) < 0) {
+			warn("pipe");
+			break;
+		}
+		pids[nrun] = runstage(stages[nrun], infd, fds[1]);
+		if (infd != STDIN_FILENO) {
+			close(infd);
+		}
+		if (fds[1] != STDOUT_FILENO) {
+			close(fds[1]);
+		}
+		infd = fds[0];
+		if (pids[nrun] < 0) {
 			break;
+		}
+	}
+	if (infd >= 0 && infd != STDIN_FILENO) {
+		close(infd);
+	}
+
+	if (nrun < nstages) {
+		/* reap what did start; it sees EOF or EPIPE soon enough */
+		for (i=0; i<nrun; i++) {
+			waitpid(pids[i], &status, 0);
+		}
+		return _MKWAIT_EXIT(1);
 	}
 
 	/* parent */
 	if (bg) {
 		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
+		for (i=0; i<nstages; i++) {
+			remember_bg(pids[i]);
+			printf("[%d] %s ... &\n", pids[i], stages[i][0]);
+		}
 		return 0;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		status = -1;
+	status = 0;
+	for (i=0; i<nstages; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+			status = -1;
+		}
 	}
 
 	if (timing) {
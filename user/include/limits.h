@@ -48,6 +48,7 @@
 #define LOGIN_NAME_MAX  __LOGIN_NAME_MAX
 #define OPEN_MAX        __OPEN_MAX
 #define IOV_MAX         __IOV_MAX
+#define THREAD_MAX      __THREAD_MAX
 
 
 #endif /* _LIMITS_H_ */
@@ -0,0 +1,22 @@
+#ifndef _SYS_SYSBATCH_H_
+#define _SYS_SYSBATCH_H_
+
+/*
+ * Batched system calls. The ring layout and how to use it are
+ * described in <kern/sysbatch.h>.
+ */
+#include <sys/types.h>
+#include <kern/syscall.h>
+#include <kern/sysbatch.h>
+
+/*
+ * Register RING, which must have room for SYSBATCH_SIZE(ENTRIES)
+ * bytes, or forget the current ring if RING is NULL. ENTRIES must be
+ * a power of two no larger than SYSBATCH_MAX.
+ */
+int sysbatch_setup(struct sysbatch_ring *ring, unsigned entries);
+
+/* Run up to COUNT queued calls; returns how many were run. */
+int sysbatch_enter(unsigned count);
+
+#endif /* _SYS_SYSBATCH_H_ */
@@ -0,0 +1,18 @@
+#ifndef _SYS_SYSCALLSTAT_H_
+#define _SYS_SYSCALLSTAT_H_
+
+/*
+ * System call statistics; see <kern/syscallstat.h>.
+ */
+#include <sys/types.h>
+#include <kern/syscall.h>
+#include <kern/syscallstat.h>
+
+/*
+ * Get the kernel's counts and latency histogram for system call
+ * CALLNO (a SYS_ number), summed over all cpus and processes. Fails
+ * with ENOSYS if the kernel doesn't keep them.
+ */
+int syscallstat(int callno, struct syscallstat *stat);
+
+#endif /* _SYS_SYSCALLSTAT_H_ */
@@ -148,12 +148,30 @@ int chdir(const char *path);
 /* Optional. */
 void *sbrk(int change);
 int getdirentry(int filehandle, char *buf, size_t buflen);
+/* getdirentries - see dirent.h */
 int symlink(const char *target, const char *linkname);
 int readlink(const char *path, char *buf, size_t buflen);
+int pread(int filehandle, void *buf, size_t size, off_t pos);
+int pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+/* readv, writev - see sys/uio.h */
+/*
+ * Copy LEN bytes from INFD to OUTFD within the kernel. A NULL offset
+ * pointer means use (and advance) that file's seek position; otherwise
+ * the copy starts at *OFF, which is advanced instead. Returns the
+ * number of bytes copied, 0 at end of file. FLAGS must be 0.
+ */
+int copy_file_range(int infd, off_t *inoff, int outfd, off_t *outoff,
+		    size_t len, unsigned flags);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 int __getcwd(char *buf, size_t buflen);
+int __threadcreate(void (*entry)(void *), void *stack, void *arg);
+__DEAD void threadexit(int status);
+int __threadjoin(int tid, int *status);
+int futex_wait(volatile int *addr, int val);
+int futex_wake(volatile int *addr, int count);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -164,4 +182,27 @@ int __getcwd(char *buf, size_t buflen);
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
 
+/*
+ * spawn runs PROG with ARGS in a new child process, like fork then
+ * execv but without copying the caller's address space, and returns
+ * the child's pid; errors finding or loading PROG come back from
+ * spawn itself. If FDMAP is NULL the child inherits all open files;
+ * otherwise it gets only fds 0 to NFDS-1, where fd I is the caller's
+ * fd FDMAP[I], or closed if that is -1.
+ */
+pid_t spawn(const char *prog, char *const *args, const int *fdmap, int nfds);
+
+/*
+ * Threads. threadcreate runs FUNC(ARG) in a new thread of this process
+ * on a stack of its own, and returns its thread id; returning from
+ * FUNC is the same as threadexit(0). threadjoin waits for a thread to
+ * finish, gets its threadexit status, and frees its stack. Threads
+ * share everything but their stacks; note that malloc is not
+ * thread-safe. _exit records the process's exit status but doesn't
+ * stop the other threads: the process exits when its last thread does.
+ */
+int threadcreate(void (*func)(void *), void *arg);	/* calls __threadcreate */
+int threadfork(void (*func)(void));			/* calls __threadcreate */
+int threadjoin(int tid, int *status);			/* calls __threadjoin */
+
 #endif /* _UNISTD_H_ */
@@ -38,6 +38,7 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <err.h>
 #include <stdint.h>  // for uintptr_t on non-OS/161 platforms
 
@@ -59,7 +60,7 @@
  *
  * mh_nextblock is the upwards offset to the next header.
  *
- * mh_pad is unused.
+ * mh_pad is 1 if the block has a mapping of its own (see MMAP_THRESHOLD).
  * mh_inuse is 1 if the block is in use, 0 if it is free.
  * mh_magic* should always be a fixed value.
  *
@@ -133,6 +134,16 @@ struct mheader {
 
 #define M_MKFIELD(off)	((off)>>MBLOCKSHIFT)
 
+/*
+ * Blocks of at least MMAP_THRESHOLD bytes get an anonymous mapping of
+ * their own instead of space in the heap, so freeing one gives the
+ * memory straight back to the kernel and can't leave a hole in the
+ * heap. The header sits at the start of the mapping; its mh_nextblock
+ * covers the whole mapping and its mh_prevblock is 0.
+ */
+#define MMAP_THRESHOLD	(64*1024)
+#define MMAP_PAGESIZE	4096
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -279,6 +290,37 @@ __malloc_sbrk(size_t size)
 	return x;
 }
 
+/*
+ * Get a block of its own mapping with size bytes for data, or NULL.
+ */
+static
+void *
+__malloc_mmap(size_t size)
+{
+	struct mheader *mh;
+	size_t total;
+
+	total = (size + MBLOCKSIZE + MMAP_PAGESIZE - 1) &
+		~(size_t)(MMAP_PAGESIZE-1);
+	if (total < size) {
+		return NULL;
+	}
+
+	mh = mmap(NULL, total, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE,
+		  -1, 0);
+	if (mh == MAP_FAILED) {
+		return NULL;
+	}
+
+	mh->mh_prevblock = 0;
+	mh->mh_magic1 = MMAGIC;
+	mh->mh_magic2 = MMAGIC;
+	mh->mh_pad = 1;
+	mh->mh_inuse = 1;
+	mh->mh_nextblock = M_MKFIELD(total);
+	return M_DATA(mh);
+}
+
 /*
  * Make a new (free) block from the block passed in, leaving size
  * bytes for data in the current block. size must be a multiple of
@@ -354,6 +396,17 @@ malloc(size_t size)
 	/* Round size up to an integral number of blocks. */
 	size = ((size + MBLOCKSIZE - 1) & ~(size_t)(MBLOCKSIZE-1));
 
+	/* Big blocks get their own mapping, if there's room for one. */
+	if (size >= MMAP_THRESHOLD) {
+		void *x = __malloc_mmap(size);
+		if (x != NULL) {
+#ifdef MALLOCDEBUG
+			warnx("malloc: mapped at %p", x);
+#endif
+			return x;
+		}
+	}
+
 	/*
 	 * First-fit search algorithm for available blocks.
 	 * Check to make sure the next/previous sizes all agree.
@@ -495,6 +548,18 @@ free(void *x)
 		     (unsigned long) __heapbase, (unsigned long) __heaptop);
 	}
 
+	/* Blocks with a mapping of their own go straight back. */
+	if (((uintptr_t)x < __heapbase || (uintptr_t)x >= __heaptop) &&
+	    (uintptr_t)x % MMAP_PAGESIZE == MBLOCKSIZE) {
+		mh = ((struct mheader *)x)-1;
+		if (M_OK(mh) && mh->mh_pad && mh->mh_inuse) {
+			if (munmap(mh, M_NEXTOFF(mh)) < 0) {
+				err(1, "free: munmap of %p failed", x);
+			}
+			return;
+		}
+	}
+
 	/* Don't allow freeing pointers that aren't on the heap. */
 	if ((uintptr_t)x < __heapbase || (uintptr_t)x >= __heaptop) {
 		errx(1, "free: Invalid pointer %p freed (out of range)", x);
@@ -0,0 +1,84 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+
+/*
+ * User threads. The kernel's __threadcreate just starts a thread at a
+ * given pc and stack pointer; here we supply the stack, and a
+ * trampoline so that returning from the thread function exits the
+ * thread.
+ *
+ * Each thread's stack is a malloc'd block, remembered by thread id so
+ * threadjoin can free it. The function and argument are kept at the
+ * top of the stack, above where the thread's frames start.
+ */
+
+#define THREAD_STACKSIZE	(64*1024)
+
+struct threadargs {
+	void (*ta_func)(void *);
+	void *ta_arg;
+};
+
+static void *thread_stacks[THREAD_MAX];
+
+static
+void
+threadstart(void *p)
+{
+	struct threadargs *ta = p;
+
+	ta->ta_func(ta->ta_arg);
+	threadexit(0);
+}
+
+int
+threadcreate(void (*func)(void *), void *arg)
+{
+	char *stack;
+	struct threadargs *ta;
+	uintptr_t sp;
+	int tid;
+
+	stack = malloc(THREAD_STACKSIZE);
+	if (stack == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	ta = (struct threadargs *)(stack + THREAD_STACKSIZE) - 1;
+	ta->ta_func = func;
+	ta->ta_arg = arg;
+
+	/* Leave room for the callee to save its arguments; keep aligned */
+	sp = ((uintptr_t)ta - 32) & ~(uintptr_t)7;
+
+	tid = __threadcreate(threadstart, (void *)sp, ta);
+	if (tid < 0) {
+		free(stack);
+		return -1;
+	}
+	thread_stacks[tid] = stack;
+	return tid;
+}
+
+int
+threadfork(void (*func)(void))
+{
+	return threadcreate((void (*)(void *))func, NULL);
+}
+
+int
+threadjoin(int tid, int *status)
+{
+	if (__threadjoin(tid, status) < 0) {
+		return -1;
+	}
+	if (tid >= 0 && tid < THREAD_MAX) {
+		free(thread_stacks[tid]);
+		thread_stacks[tid] = NULL;
+	}
+	return 0;
+}
@@ -49,6 +49,15 @@ wait_badpid(int pid, const char *desc)
 	report_test2(rv, errno, EINVAL, NOSUCHPID_ERROR, desc);
 }
 
+static
+void
+wait_nochildren(void)
+{
+	int rv, x;
+	rv = waitpid(-1, &x, 0);
+	report_test(rv, errno, ECHILD, "wait for any child with none");
+}
+
 static
 void
 wait_badstatus(void *ptr, const char *desc)
@@ -270,7 +279,7 @@ void
 test_waitpid(void)
 {
 	wait_badpid(-8, "wait for pid -8");
-	wait_badpid(-1, "wait for pid -1");
+	wait_nochildren();
 	wait_badpid(0, "pid zero");
 	wait_badpid(NONEXIST_PID, "nonexistent pid");
 
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * batchbench - cost of system calls made one trap each versus the
+ * same calls queued on the batched syscall ring.
+ *
+ * Usage: batchbench [calls]
+ *
+ * Makes CALLS lseek calls and CALLS one-byte writes on null:, first
+ * directly and then RINGSIZE at a time through sysbatch_enter, and
+ * prints the average time per call in nanoseconds for each.
+ */
+
+#include <sys/types.h>
+#include <sys/sysbatch.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_CALLS	20000
+#define RINGSIZE	64
+
+/* long long, to keep the ring 8-byte aligned */
+static long long ringmem[SYSBATCH_SIZE(RINGSIZE) / sizeof(long long)];
+static struct sysbatch_ring *ring = (struct sysbatch_ring *)ringmem;
+
+static char byte = 'x';
+
+/*
+ * Current time in microseconds.
+ */
+static
+unsigned long long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (unsigned long long)secs * 1000000ULL + nsecs / 1000;
+}
+
+/*
+ * Make CALLS calls of OP on FD, one trap each.
+ */
+static
+void
+direct(int op, int fd, unsigned calls)
+{
+	unsigned i;
+
+	for (i=0; i<calls; i++) {
+		if (op == SYS_lseek) {
+			if (lseek(fd, 0, SEEK_SET) != 0) {
+				err(1, "lseek");
+			}
+		}
+		else {
+			if (write(fd, &byte, 1) != 1) {
+				err(1, "write");
+			}
+		}
+	}
+}
+
+/*
+ * Make CALLS calls of OP on FD through the ring.
+ */
+static
+void
+batched(int op, int fd, unsigned calls)
+{
+	struct sysbatch_sqe *sqe;
+	struct sysbatch_cqe *cqe;
+	unsigned done, n, i;
+	long long expect;
+	int r;
+
+	expect = (op == SYS_lseek) ? 0 : 1;
+	for (done = 0; done < calls; done += n) {
+		n = calls - done;
+		if (n > RINGSIZE) {
+			n = RINGSIZE;
+		}
+		for (i=0; i<n; i++) {
+			sqe = &ring->sb_sqes[ring->sb_sqtail % RINGSIZE];
+			sqe->sqe_op = op;
+			sqe->sqe_fd = fd;
+			sqe->sqe_addr = &byte;
+			sqe->sqe_len = 1;
+			sqe->sqe_off = 0;
+			sqe->sqe_flags = SEEK_SET;
+			sqe->sqe_data = done + i;
+			ring->sb_sqtail++;
+		}
+
+		r = sysbatch_enter(n);
+		if (r < 0) {
+			err(1, "sysbatch_enter");
+		}
+		if ((unsigned)r != n) {
+			errx(1, "sysbatch_enter: ran %d of %u calls", r, n);
+		}
+
+		while (ring->sb_cqhead != ring->sb_cqtail) {
+			cqe = &SYSBATCH_CQES(ring)[ring->sb_cqhead % RINGSIZE];
+			if (cqe->cqe_res < 0) {
+				errno = cqe->cqe_err;
+				err(1, "batched call %u", cqe->cqe_data);
+			}
+			if (cqe->cqe_res != expect) {
+				errx(1, "batched call %u: got %lld",
+				     cqe->cqe_data, cqe->cqe_res);
+			}
+			ring->sb_cqhead++;
+		}
+	}
+}
+
+/*
+ * Time CALLS calls of OP made by FUNC, and print nanoseconds per call.
+ */
+static
+void
+timeit(void (*func)(int, int, unsigned), int op, int fd, unsigned calls)
+{
+	unsigned long long start, usecs;
+
+	start = now();
+	func(op, fd, calls);
+	usecs = now() - start;
+	printf(" %10llu", usecs * 1000ULL / calls);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned calls;
+	int fd;
+
+	calls = DEFAULT_CALLS;
+	if (argc > 1) {
+		calls = atoi(argv[1]);
+	}
+	if (argc > 2 || calls == 0) {
+		errx(1, "Usage: batchbench [calls]");
+	}
+
+	fd = open("null:", O_WRONLY);
+	if (fd < 0) {
+		err(1, "null:");
+	}
+	if (sysbatch_setup(ring, RINGSIZE) < 0) {
+		err(1, "sysbatch_setup");
+	}
+
+	printf("%u calls, ring of %d; ns per call\n", calls, RINGSIZE);
+	printf("%-8s %10s %10s\n", "call", "direct", "batched");
+
+	printf("%-8s", "lseek");
+	timeit(direct, SYS_lseek, fd, calls);
+	timeit(batched, SYS_lseek, fd, calls);
+	printf("\n");
+
+	printf("%-8s", "write");
+	timeit(direct, SYS_write, fd, calls);
+	timeit(batched, SYS_write, fd, calls);
+	printf("\n");
+
+	sysbatch_setup(NULL, 0);
+	close(fd);
+	return 0;
+}
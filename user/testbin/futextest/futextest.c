@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futextest - user-level mutex built on futex_wait/futex_wake.
+ *
+ * Usage: futextest [nthreads [loops]]
+ *
+ * Starts NTHREADS threads that each increment a shared counter LOOPS
+ * times under a mutex, then checks the total. The mutex only enters
+ * the kernel when it's contended; the number of futex_wait and
+ * futex_wake calls made is printed at the end to show how often that
+ * was.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <err.h>
+
+#define DEFAULT_NTHREADS	4
+#define DEFAULT_LOOPS		20000
+
+/*
+ * Atomic operations (MIPS load-linked/store-conditional).
+ */
+static
+int
+cas(volatile int *p, int old, int new)
+{
+	int cur, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips2;"
+		".set noreorder;"
+		"1: ll %0, 0(%2);"
+		"   bne %0, %3, 2f;"
+		"   move %1, %4;"
+		"   sc %1, 0(%2);"
+		"   beqz %1, 1b;"
+		"   nop;"
+		"2: .set pop"
+		: "=&r" (cur), "=&r" (tmp)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return cur;
+}
+
+static
+int
+xchg(volatile int *p, int new)
+{
+	int old, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips2;"
+		".set noreorder;"
+		"1: ll %0, 0(%2);"
+		"   move %1, %3;"
+		"   sc %1, 0(%2);"
+		"   beqz %1, 1b;"
+		"   nop;"
+		".set pop"
+		: "=&r" (old), "=&r" (tmp)
+		: "r" (p), "r" (new)
+		: "memory");
+	return old;
+}
+
+/*
+ * The mutex word is 0 when unlocked, 1 when locked, and 2 when
+ * locked and somebody may be waiting.
+ */
+static volatile int mutex;
+static volatile int nwaits, nwakes;	/* protected by mutex */
+
+static
+void
+mutex_lock(void)
+{
+	int c, waits;
+
+	c = cas(&mutex, 0, 1);
+	if (c == 0) {
+		return;
+	}
+	waits = 0;
+	if (c != 2) {
+		c = xchg(&mutex, 2);
+	}
+	while (c != 0) {
+		futex_wait(&mutex, 2);
+		waits++;
+		c = xchg(&mutex, 2);
+	}
+	nwaits += waits;
+}
+
+static
+void
+mutex_unlock(void)
+{
+	if (xchg(&mutex, 0) == 2) {
+		nwakes++;
+		futex_wake(&mutex, 1);
+	}
+}
+
+static volatile unsigned long counter;
+static int loops;
+
+static
+void
+worker(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i=0; i<loops; i++) {
+		mutex_lock();
+		counter++;
+		mutex_unlock();
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int tids[THREAD_MAX];
+	int nthreads, i;
+	unsigned long expected;
+
+	nthreads = DEFAULT_NTHREADS;
+	loops = DEFAULT_LOOPS;
+	if (argc > 1) {
+		nthreads = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		loops = atoi(argv[2]);
+	}
+	if (nthreads < 1 || nthreads >= THREAD_MAX || loops < 1) {
+		errx(1, "Usage: futextest [nthreads [loops]]");
+	}
+
+	for (i=0; i<nthreads; i++) {
+		tids[i] = threadcreate(worker, NULL);
+		if (tids[i] < 0) {
+			err(1, "threadcreate");
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		if (threadjoin(tids[i], NULL) < 0) {
+			err(1, "threadjoin");
+		}
+	}
+
+	expected = (unsigned long)nthreads * loops;
+	printf("futextest: %d threads x %d: counter %lu, "
+	       "%d futex_wait, %d futex_wake\n",
+	       nthreads, loops, counter, nwaits, nwakes);
+	if (counter != expected) {
+		errx(1, "FAILED: expected %lu", expected);
+	}
+	printf("futextest: passed\n");
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * iobench - read/write throughput at various buffer sizes.
+ *
+ * Usage: iobench [file [kbytes]]
+ *
+ * For each buffer size from 512 bytes up to 64K, writes KBYTES of
+ * data to FILE with that size of write call, reads it back with the
+ * same size of read call, and prints the rate of each in MB/s. The
+ * file is removed afterwards. If the kernel keeps system call
+ * statistics, the number of read and write calls and the average time
+ * each spent in the kernel are printed at the end.
+ */
+
+#include <sys/syscallstat.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_FILE	"iobench.tmp"
+#define DEFAULT_KBYTES	1024
+
+#define MINBUF		512
+#define MAXBUF		(64*1024)
+
+static char buf[MAXBUF];
+
+/*
+ * Current time in microseconds.
+ */
+static
+unsigned long long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (unsigned long long)secs * 1000000ULL + nsecs / 1000;
+}
+
+/*
+ * Print the rate for KBYTES in USECS as MB/s with two decimals.
+ */
+static
+void
+printrate(unsigned long kbytes, unsigned long long usecs)
+{
+	unsigned long hundredths;
+
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	hundredths = (unsigned long)
+		((unsigned long long)kbytes * 100000000ULL / 1024 / usecs);
+	printf(" %9lu.%02lu", hundredths / 100, hundredths % 100);
+}
+
+/*
+ * Do TOTAL bytes of I/O in BUFSIZE pieces, writing if WRITING.
+ */
+static
+void
+dopass(const char *file, size_t bufsize, size_t total, int writing)
+{
+	size_t done;
+	int fd, r;
+
+	if (writing) {
+		fd = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	}
+	else {
+		fd = open(file, O_RDONLY);
+	}
+	if (fd < 0) {
+		err(1, "%s", file);
+	}
+
+	for (done = 0; done < total; done += r) {
+		if (writing) {
+			r = write(fd, buf, bufsize);
+		}
+		else {
+			r = read(fd, buf, bufsize);
+		}
+		if (r < 0) {
+			err(1, "%s: %s", file, writing ? "write" : "read");
+		}
+		if (r == 0) {
+			errx(1, "%s: Unexpected EOF", file);
+		}
+	}
+	close(fd);
+}
+
+/*
+ * Print the kernel's count and average time for CALLNO since BEFORE.
+ */
+static
+void
+printkstats(const char *name, int callno, const struct syscallstat *before)
+{
+	struct syscallstat after;
+	unsigned long long calls, nsecs;
+
+	if (syscallstat(callno, &after) < 0) {
+		return;
+	}
+	calls = after.ss_calls - before->ss_calls;
+	nsecs = after.ss_nsecs - before->ss_nsecs;
+	printf("%-5s %10llu calls, %8llu ns average in the kernel\n",
+	       name, calls, calls ? nsecs / calls : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *file;
+	unsigned long kbytes;
+	size_t bufsize, total;
+	unsigned long long start, wtime, rtime;
+	struct syscallstat rstat, wstat;
+	int havestats;
+
+	file = DEFAULT_FILE;
+	kbytes = DEFAULT_KBYTES;
+	if (argc > 1) {
+		file = argv[1];
+	}
+	if (argc > 2) {
+		kbytes = atoi(argv[2]);
+	}
+	if (kbytes < MAXBUF / 1024) {
+		errx(1, "Usage: iobench [file [kbytes]] (kbytes >= %d)",
+		     MAXBUF / 1024);
+	}
+	total = kbytes * 1024;
+
+	memset(buf, 'x', sizeof(buf));
+
+	havestats = syscallstat(SYS_read, &rstat) == 0 &&
+		syscallstat(SYS_write, &wstat) == 0;
+
+	printf("%8s %12s %12s\n", "bufsize", "write MB/s", "read MB/s");
+	for (bufsize = MINBUF; bufsize <= MAXBUF; bufsize *= 2) {
+		start = now();
+		dopass(file, bufsize, total, 1);
+		wtime = now() - start;
+
+		start = now();
+		dopass(file, bufsize, total, 0);
+		rtime = now() - start;
+
+		printf("%8u", (unsigned)bufsize);
+		printrate(kbytes, wtime);
+		printrate(kbytes, rtime);
+		printf("\n");
+	}
+
+	if (havestats) {
+		printkstats("read", SYS_read, &rstat);
+		printkstats("write", SYS_write, &wstat);
+	}
+
+	remove(file);
+	return 0;
+}
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * pipebench - pipe throughput.
+ *
+ * Usage: pipebench [-s] [kbytes [chunk]]
+ *
+ * A child process writes KBYTES of data into a pipe in CHUNK-byte
+ * writes while the parent reads it out in CHUNK-byte reads and checks
+ * it. Prints the time taken and the throughput.
+ *
+ * With -s the directions are swapped: the parent writes, and the
+ * reader is a copy of this program started with spawn and an fd map
+ * that puts the read end on its standard input and gives it nothing
+ * else. That checks that the map is what the child gets; if it kept
+ * the write end too, it would never see end of file.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+
+#define PROG		"/testbin/pipebench"
+
+#define DEFAULT_KBYTES	4096
+#define DEFAULT_CHUNK	4096
+
+/*
+ * Current time in microseconds.
+ */
+static
+unsigned long long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (unsigned long long)secs * 1000000ULL + nsecs / 1000;
+}
+
+/*
+ * The byte at offset POS of the stream.
+ */
+static
+char
+pattern(unsigned long long pos)
+{
+	return (char)(pos % 251);
+}
+
+static
+void
+writer(int fd, unsigned long long total, char *buf, size_t chunk)
+{
+	unsigned long long pos;
+	size_t n, i;
+	ssize_t r;
+
+	for (pos = 0; pos < total; pos += r) {
+		n = chunk;
+		if (n > total - pos) {
+			n = total - pos;
+		}
+		for (i=0; i<n; i++) {
+			buf[i] = pattern(pos + i);
+		}
+		r = write(fd, buf, n);
+		if (r <= 0) {
+			err(1, "write");
+		}
+	}
+}
+
+static
+unsigned long long
+reader(int fd, char *buf, size_t chunk)
+{
+	unsigned long long pos;
+	ssize_t r, i;
+
+	pos = 0;
+	while ((r = read(fd, buf, chunk)) > 0) {
+		for (i=0; i<r; i++) {
+			if (buf[i] != pattern(pos + i)) {
+				errx(1, "Wrong data at byte %llu", pos + i);
+			}
+		}
+		pos += r;
+	}
+	if (r < 0) {
+		err(1, "read");
+	}
+	return pos;
+}
+
+/*
+ * The spawned reader for -s: pipebench -r kbytes chunk wfd. Reads the
+ * stream from standard input, where spawn's fd map put it, and makes
+ * sure the parent's write end WFD didn't come along.
+ */
+static
+int
+spawnedreader(int argc, char *argv[])
+{
+	unsigned long long total, got;
+	size_t chunk;
+	char *buf;
+	int wfd;
+
+	if (argc != 5) {
+		errx(1, "Usage: pipebench -r kbytes chunk wfd");
+	}
+	total = atoi(argv[2]) * 1024ULL;
+	chunk = atoi(argv[3]);
+	wfd = atoi(argv[4]);
+
+	if (close(wfd) == 0 || errno != EBADF) {
+		errx(1, "Spawned reader has fd %d; fd map not applied", wfd);
+	}
+
+	buf = malloc(chunk);
+	if (buf == NULL) {
+		errx(1, "Out of memory for a %lu-byte buffer",
+		     (unsigned long)chunk);
+	}
+	got = reader(STDIN_FILENO, buf, chunk);
+	if (got != total) {
+		errx(1, "Read %llu bytes, expected %llu", got, total);
+	}
+	return 0;
+}
+
+/*
+ * Start the reader for -s on the read end RFD. Returns its pid.
+ */
+static
+pid_t
+spawnreader(int rfd, int wfd, unsigned long long total, size_t chunk)
+{
+	char kbstr[32], chunkstr[32], wfdstr[32];
+	char *args[6];
+	int fdmap[3];
+	pid_t pid;
+
+	snprintf(kbstr, sizeof(kbstr), "%llu", total / 1024);
+	snprintf(chunkstr, sizeof(chunkstr), "%lu", (unsigned long)chunk);
+	snprintf(wfdstr, sizeof(wfdstr), "%d", wfd);
+	args[0] = (char *)PROG;
+	args[1] = (char *)"-r";
+	args[2] = kbstr;
+	args[3] = chunkstr;
+	args[4] = wfdstr;
+	args[5] = NULL;
+
+	fdmap[STDIN_FILENO] = rfd;
+	fdmap[STDOUT_FILENO] = STDOUT_FILENO;
+	fdmap[STDERR_FILENO] = STDERR_FILENO;
+
+	pid = spawn(PROG, args, fdmap, 3);
+	if (pid < 0) {
+		err(1, "spawn: %s", PROG);
+	}
+	return pid;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long long total, got, start, usecs;
+	size_t chunk;
+	char *buf;
+	int fds[2];
+	int status, sflag;
+	pid_t pid;
+
+	if (argc > 1 && !strcmp(argv[1], "-r")) {
+		return spawnedreader(argc, argv);
+	}
+
+	sflag = 0;
+	if (argc > 1 && !strcmp(argv[1], "-s")) {
+		sflag = 1;
+		argc--;
+		argv++;
+	}
+
+	total = DEFAULT_KBYTES;
+	chunk = DEFAULT_CHUNK;
+	if (argc > 1) {
+		total = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		chunk = atoi(argv[2]);
+	}
+	if (argc > 3 || total == 0 || chunk == 0) {
+		errx(1, "Usage: pipebench [-s] [kbytes [chunk]]");
+	}
+	total *= 1024;
+
+	buf = malloc(chunk);
+	if (buf == NULL) {
+		errx(1, "Out of memory for a %lu-byte buffer",
+		     (unsigned long)chunk);
+	}
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	start = now();
+	if (sflag) {
+		pid = spawnreader(fds[0], fds[1], total, chunk);
+		close(fds[0]);
+		writer(fds[1], total, buf, chunk);
+		close(fds[1]);
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		usecs = now() - start;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "Reader failed (status 0x%x)", status);
+		}
+	}
+	else {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			close(fds[0]);
+			writer(fds[1], total, buf, chunk);
+			_exit(0);
+		}
+		close(fds[1]);
+		got = reader(fds[0], buf, chunk);
+		usecs = now() - start;
+
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "Writer failed (status 0x%x)", status);
+		}
+		if (got != total) {
+			errx(1, "Read %llu bytes, expected %llu", got, total);
+		}
+	}
+
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	printf("%llu KB in %lu-byte chunks: %llu us, %llu KB/s\n",
+	       total / 1024, (unsigned long)chunk, usecs,
+	       total * 1000000ULL / 1024 / usecs);
+	return 0;
+}
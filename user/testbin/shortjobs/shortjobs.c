@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * shortjobs - throughput of many short-lived compute jobs.
+ *
+ * Usage: shortjobs [njobs [nconc [work]]]
+ *
+ * Runs NJOBS child processes in total, keeping up to NCONC of them
+ * alive at once. Each child spins through WORK iterations of a
+ * trivial compute loop and exits. The elapsed time and the resulting
+ * job throughput are printed at the end.
+ *
+ * This is meant for measuring the scheduler's load balancing. Run it
+ * on System/161 configured with different numbers of CPUs (the
+ * "cpus" setting in sys161.conf) and compare the jobs/sec figures;
+ * with good balancing throughput should scale with the CPU count
+ * until NCONC is the limiting factor.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define DEFAULT_NJOBS	128
+#define DEFAULT_NCONC	16
+#define DEFAULT_WORK	20000
+
+#define MAXCONC		64
+
+static
+void
+work(int amount)
+{
+	volatile int i;
+
+	for (i=0; i<amount; i++)
+		;
+}
+
+static
+pid_t
+spawnjob(int amount)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		work(amount);
+		_exit(0);
+	}
+	return pid;
+}
+
+static
+void
+reapjob(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		warnx("pid %d: exit %d", pid, WEXITSTATUS(status));
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int njobs = DEFAULT_NJOBS;
+	int nconc = DEFAULT_NCONC;
+	int amount = DEFAULT_WORK;
+	pid_t pids[MAXCONC];
+	time_t startsecs, endsecs;
+	unsigned long startnsecs, endnsecs;
+	unsigned long msecs;
+	int started, i, batch;
+
+	if (argc > 1) {
+		njobs = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		nconc = atoi(argv[2]);
+	}
+	if (argc > 3) {
+		amount = atoi(argv[3]);
+	}
+	if (argc > 4 || njobs <= 0 || nconc <= 0 || amount < 0) {
+		errx(1, "Usage: shortjobs [njobs [nconc [work]]]");
+	}
+	if (nconc > MAXCONC) {
+		nconc = MAXCONC;
+	}
+
+	printf("shortjobs: %d jobs, %d at a time, %d iterations each\n",
+	       njobs, nconc, amount);
+
+	__time(&startsecs, &startnsecs);
+
+	/*
+	 * Run in batches of NCONC. Waiting for a whole batch rather
+	 * than any single child keeps this usable with a waitpid()
+	 * that only knows about explicit pids.
+	 */
+	for (started = 0; started < njobs; started += batch) {
+		batch = njobs - started;
+		if (batch > nconc) {
+			batch = nconc;
+		}
+		for (i=0; i<batch; i++) {
+			pids[i] = spawnjob(amount);
+		}
+		for (i=0; i<batch; i++) {
+			reapjob(pids[i]);
+		}
+	}
+
+	__time(&endsecs, &endnsecs);
+	if (endnsecs < startnsecs) {
+		endnsecs += 1000000000;
+		endsecs--;
+	}
+	endnsecs -= startnsecs;
+	endsecs -= startsecs;
+
+	msecs = (unsigned long)endsecs * 1000 + endnsecs / 1000000;
+	printf("shortjobs: %lu.%09lu seconds", (unsigned long) endsecs,
+	       endnsecs);
+	if (msecs > 0) {
+		printf(", %lu jobs/sec",
+		       (unsigned long)njobs * 1000 / msecs);
+	}
+	printf("\n");
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * spawnbench - latency of starting a program with fork and execv
+ * versus spawn.
+ *
+ * Usage: spawnbench [runs [kbytes]]
+ *
+ * Starts a trivial program (this one, told to exit at once) RUNS
+ * times each way, waiting for it each time, and prints the average
+ * time per start in microseconds. To show how fork's cost grows with
+ * the size of the parent, KBYTES of heap are touched first.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+
+#define PROG		"/testbin/spawnbench"
+#define DEFAULT_RUNS	50
+
+static char *childargs[] = { (char *)PROG, (char *)"-child", NULL };
+
+/*
+ * Current time in microseconds.
+ */
+static
+unsigned long long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (unsigned long long)secs * 1000000ULL + nsecs / 1000;
+}
+
+static
+void
+waitfor(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "child failed (status 0x%x)", status);
+	}
+}
+
+static
+void
+viafork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(PROG, childargs);
+		warn("%s", PROG);
+		_exit(1);
+	}
+	waitfor(pid);
+}
+
+static
+void
+viaspawn(void)
+{
+	pid_t pid;
+
+	pid = spawn(PROG, childargs, NULL, 0);
+	if (pid < 0) {
+		err(1, "spawn: %s", PROG);
+	}
+	waitfor(pid);
+}
+
+/*
+ * Run FUNC RUNS times and print microseconds per run.
+ */
+static
+void
+timeit(const char *name, void (*func)(void), unsigned runs)
+{
+	unsigned long long start, usecs;
+	unsigned i;
+
+	start = now();
+	for (i=0; i<runs; i++) {
+		func();
+	}
+	usecs = now() - start;
+	printf("%-12s %10llu\n", name, usecs / runs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned runs, kbytes;
+	char *heap;
+
+	if (argc == 2 && !strcmp(argv[1], "-child")) {
+		return 0;
+	}
+
+	runs = DEFAULT_RUNS;
+	kbytes = 0;
+	if (argc > 1) {
+		runs = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		kbytes = atoi(argv[2]);
+	}
+	if (argc > 3 || runs == 0) {
+		errx(1, "Usage: spawnbench [runs [kbytes]]");
+	}
+
+	if (kbytes > 0) {
+		heap = malloc(kbytes * 1024);
+		if (heap == NULL) {
+			errx(1, "Out of memory for %u KB of heap", kbytes);
+		}
+		memset(heap, 1, kbytes * 1024);
+	}
+
+	printf("%u runs, %u KB of heap; us per start\n", runs, kbytes);
+	timeit("fork+execv", viafork, runs);
+	timeit("spawn", viaspawn, runs);
+	return 0;
+}